@@ -3,113 +3,2928 @@
 #include <cstddef>
 #include "exception.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//io_uring is used through raw system calls, no liburing needed.
+//Define __BTREE_NO_IO_URING__ to always use the thread pool.
+#if defined(__linux__) && !defined(__BTREE_NO_IO_URING__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+//IORING_OP_READ/WRITE came with the opcode probe (5.6), older headers get the thread pool.
+#ifdef IO_URING_OP_SUPPORTED
+#define __BTREE_IO_URING__
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//Shrink it (e.g. 128) when debugging, deeper trees come out quickly.
+#ifndef __BTREE_PAGE_SIZE__
+#define __BTREE_PAGE_SIZE__ 4096
+#endif
+
+#ifndef __BTREE_MAX_HEIGHT__
+#define __BTREE_MAX_HEIGHT__ 32
+#endif
+
+//Leaves scan() asks the OS to read ahead.
+#ifndef __BTREE_READAHEAD__
+#define __BTREE_READAHEAD__ 8
+#endif
+
+//Bits per key of the filter used by trees opened with a filter, see BTree(fname, format, filter).
+#ifndef __BTREE_BLOOM_BITS__
+#define __BTREE_BLOOM_BITS__ 10
+#endif
+
+//Pages in flight at once in batched IO (query_batch), and threads reading them
+//when io_uring is not there.
+#ifndef __BTREE_IO_DEPTH__
+#define __BTREE_IO_DEPTH__ 32
+#endif
+
+#ifndef __BTREE_IO_THREADS__
+#define __BTREE_IO_THREADS__ 8
+#endif
+
+//Times at() and contains() go down without a lock and find a page changed under them
+//before they wait for the writer instead, see btree_versions.
+#ifndef __BTREE_OPTIMISTIC_TRIES__
+#define __BTREE_OPTIMISTIC_TRIES__ 8
+#endif
+
+//Keys a BufferedBTree holds in memory before they go into the tree.
+#ifndef __BTREE_MEMTABLE__
+#define __BTREE_MEMTABLE__ 65536
+#endif
+
+//Pages compact() handles each time it takes the latch.
+#ifndef __BTREE_COMPACT_STEP__
+#define __BTREE_COMPACT_STEP__ 64
+#endif
+
+#define __BTREE_MAGIC__ 0x4254524a
+
 namespace sjtu {
-    template <class Key, class Value>
-    class BTree {
+    //* Page codecs
+    //How a Key or Value is laid out in a page.
+    //The default copies the raw bytes, which needs a trivially copyable type.
+    //Specialize it for anything else, std::string is done below.
+    //  common(a, b)           bytes a and b start with, leaves store them only once.
+    //  size / write / read    skip bytes of the front are left out, read puts prefix back.
+    //  separator(l, r)        shortest key s with l < s <= r, used in inner pages.
+    template <class T>
+    struct btree_codec {
+        static_assert(std::is_trivially_copyable<T>::value, "specialize sjtu::btree_codec for this type");
+        static size_t common(const T&, const T&) { return 0; }
+        static size_t size(const T&, size_t skip = 0) { return sizeof(T); }
+        static char* write(char* p, const T& x, size_t skip = 0) {
+            memcpy(p, &x, sizeof(T));
+            return p + sizeof(T);
+        }
+        static const char* read(const char* p, T& x, const char* prefix = nullptr, size_t skip = 0) {
+            memcpy(&x, p, sizeof(T));
+            return p + sizeof(T);
+        }
+        static const char* bytes(const T& x) { return reinterpret_cast<const char*>(&x); }
+        static T separator(const T&, const T& right) { return right; }
+    };
+
+    //[varint length][bytes], no padding to a maximum length.
+    template <>
+    struct btree_codec<std::string> {
+        static size_t __varint_size(size_t x) {
+            size_t n = 1;
+            while (x >= 128) {
+                x >>= 7;
+                n++;
+            }
+            return n;
+        }
+        static size_t common(const std::string& a, const std::string& b) {
+            size_t n = std::min(a.size(), b.size()), i = 0;
+            while (i < n && a[i] == b[i])
+                i++;
+            return i;
+        }
+        static size_t size(const std::string& x, size_t skip = 0) {
+            return __varint_size(x.size() - skip) + x.size() - skip;
+        }
+        static char* write(char* p, const std::string& x, size_t skip = 0) {
+            size_t len = x.size() - skip;
+            for (size_t v = len; v >= 128; v >>= 7)
+                *p++ = (char)((v & 127) | 128);
+            *p++ = (char)(len >> (7 * (__varint_size(len) - 1)));
+            memcpy(p, x.data() + skip, len);
+            return p + len;
+        }
+        static const char* read(const char* p, std::string& x, const char* prefix = nullptr, size_t skip = 0) {
+            size_t len = 0;
+            for (int shift = 0;; shift += 7) {
+                unsigned char c = *p++;
+                len |= (size_t)(c & 127) << shift;
+                if (c < 128)
+                    break;
+            }
+            x.assign(prefix == nullptr ? "" : prefix, skip);
+            x.append(p, len);
+            return p + len;
+        }
+        static const char* bytes(const std::string& x) { return x.data(); }
+        static std::string separator(const std::string& left, const std::string& right) {
+            return right.substr(0, common(left, right) + 1);
+        }
+    };
+
+    //Composite keys: first then second, each by its own codec.
+    //Only first takes part in the leaf prefix.
+    template <class T1, class T2>
+    struct btree_codec<pair<T1, T2>> {
+        typedef btree_codec<T1> first_codec;
+        typedef btree_codec<T2> second_codec;
+        static size_t common(const pair<T1, T2>& a, const pair<T1, T2>& b) {
+            return first_codec::common(a.first, b.first);
+        }
+        static size_t size(const pair<T1, T2>& x, size_t skip = 0) {
+            return first_codec::size(x.first, skip) + second_codec::size(x.second);
+        }
+        static char* write(char* p, const pair<T1, T2>& x, size_t skip = 0) {
+            return second_codec::write(first_codec::write(p, x.first, skip), x.second);
+        }
+        static const char* read(const char* p, pair<T1, T2>& x, const char* prefix = nullptr, size_t skip = 0) {
+            return second_codec::read(first_codec::read(p, x.first, prefix, skip), x.second);
+        }
+        static const char* bytes(const pair<T1, T2>& x) { return first_codec::bytes(x.first); }
+        //(a shorter first, T2()) when that still lies strictly between.
+        static pair<T1, T2> separator(const pair<T1, T2>& left, const pair<T1, T2>& right) {
+            if (!(left.first < right.first))
+                return right;
+            T1 first = first_codec::separator(left.first, right.first);
+            if (first < right.first)
+                return pair<T1, T2>(first, T2());
+            return right;
+        }
+    };
+
+    //Stands for no value at all, e.g. in BTreeIndex. Takes no bytes in a page.
+    struct btree_none {};
+
+    template <>
+    struct btree_codec<btree_none> {
+        static size_t common(const btree_none&, const btree_none&) { return 0; }
+        static size_t size(const btree_none&, size_t skip = 0) { return 0; }
+        static char* write(char* p, const btree_none&, size_t skip = 0) { return p; }
+        static const char* read(const char* p, btree_none&, const char* prefix = nullptr, size_t skip = 0) { return p; }
+        static const char* bytes(const btree_none& x) { return reinterpret_cast<const char*>(&x); }
+        static btree_none separator(const btree_none&, const btree_none& right) { return right; }
+    };
+
+    //* Packed leaves
+    //Integer keys of a leaf as [first key][width][gaps to the previous key, width bits each][8 bytes pad].
+    //Sorted keys close to each other need only a few bits apiece.
+    //Used by trees created with leaf_packed, see BTree(fname, format).
+    template <class T, bool = std::is_integral<T>::value && !std::is_same<T, bool>::value>
+    struct btree_packer {
+        static const bool enabled = false;
+        static size_t size(const T*, size_t) { return 0; }
+        static char* write(char* p, const T*, size_t) { return p; }
+        static const char* read(const char* p, T*, size_t) { return p; }
+    };
+
+    template <class T>
+    struct btree_packer<T, true> {
+        typedef typename std::make_unsigned<T>::type U;
+        static const bool enabled = true;
+
+        static int __width(const T* x, size_t n) {
+            uint64_t all = 0;
+            for (size_t i = 1; i < n; i++)
+                all |= (U)((U)x[i] - (U)x[i - 1]);
+            int w = 0;
+            while (w < 64 && (all >> w) != 0)
+                w++;
+            return w;
+        }
+        static size_t __bytes(size_t n, int w) {
+            return ((n - 1) * w + 7) / 8 + 8;
+        }
+        //bits are filled from the lowest one of each byte up.
+        static void __put(unsigned char* p, size_t bit, uint64_t v, int w) {
+            while (w > 0) {
+                p[bit >> 3] |= (unsigned char)(v << (bit & 7));
+                int used = 8 - (bit & 7);
+                v >>= used;
+                bit += used;
+                w -= used;
+            }
+        }
+        //the pad lets this read 9 bytes past any gap.
+        static uint64_t __get(const unsigned char* p, size_t bit, int w) {
+            uint64_t v;
+            memcpy(&v, p + (bit >> 3), sizeof(v));
+            v >>= bit & 7;
+            if (w + (bit & 7) > 64)
+                v |= (uint64_t)p[(bit >> 3) + 8] << (64 - (bit & 7));
+            return w == 64 ? v : v & ((uint64_t(1) << w) - 1);
+        }
+#ifdef __AVX2__
+        //8 gaps at a time for 32 bit keys: gather, shift, mask, then a prefix sum.
+        //Each lane loads 4 bytes, so width + 7 must fit in 32 bits.
+        //Returns how many keys are done.
+        static size_t __read_avx2(const unsigned char* p, T* x, size_t n, int w) {
+            const __m256i lane  = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i bit   = _mm256_mullo_epi32(lane, _mm256_set1_epi32(w));
+            const __m256i byte  = _mm256_srli_epi32(bit, 3);
+            const __m256i shift = _mm256_and_si256(bit, _mm256_set1_epi32(7));
+            const __m256i mask  = _mm256_set1_epi32((int)((1u << w) - 1));
+            __m256i carry       = _mm256_set1_epi32((int)x[0]);
+            size_t j            = 0;
+            //8 gaps take exactly w bytes.
+            for (; j + 8 <= n - 1; j += 8) {
+                __m256i v = _mm256_i32gather_epi32((const int*)(p + j / 8 * w), byte, 1);
+                v         = _mm256_and_si256(_mm256_srlv_epi32(v, shift), mask);
+                v         = _mm256_add_epi32(v, _mm256_slli_si256(v, 4));
+                v         = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+                //each half is summed on its own so far, carry the low half into the high one.
+                __m256i low = _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(3));
+                v           = _mm256_add_epi32(v, _mm256_blend_epi32(_mm256_setzero_si256(), low, 0xF0));
+                v           = _mm256_add_epi32(v, carry);
+                _mm256_storeu_si256((__m256i*)(x + j + 1), v);
+                carry = _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7));
+            }
+            return j + 1;
+        }
+#endif
+
+        static size_t size(const T* x, size_t n) {
+            return n == 0 ? 0 : sizeof(T) + 1 + __bytes(n, __width(x, n));
+        }
+        static char* write(char* p, const T* x, size_t n) {
+            if (n == 0)
+                return p;
+            memcpy(p, x, sizeof(T));
+            p += sizeof(T);
+            int w  = __width(x, n);
+            *p++   = (char)w;
+            auto b = (unsigned char*)p;
+            memset(b, 0, __bytes(n, w));
+            for (size_t i = 1; i < n; i++)
+                __put(b, (i - 1) * w, (U)((U)x[i] - (U)x[i - 1]), w);
+            return p + __bytes(n, w);
+        }
+        static const char* read(const char* p, T* x, size_t n) {
+            if (n == 0)
+                return p;
+            memcpy(x, p, sizeof(T));
+            p += sizeof(T);
+            int w  = (unsigned char)*p++;
+            auto b = (const unsigned char*)p;
+            size_t i = 1;
+#ifdef __AVX2__
+            if (sizeof(T) == 4 && w <= 25)
+                i = __read_avx2(b, x, n, w);
+#endif
+            for (; i < n; i++)
+                x[i] = (T)((U)x[i - 1] + (U)__get(b, (i - 1) * w, w));
+            return p + __bytes(n, w);
+        }
+    };
+
+    //* Node search
+    //lower_bound / upper_bound over the sorted keys of a node, for arithmetic keys in their natural order.
+    //Binary search without branches until the range is two cache lines, then every key of it
+    //is compared at once (AVX2 or SSE2 compares) and the hits summed,
+    //so no step depends on a compare the CPU has to guess.
+    //Other types, and other orders, go through BTree's own binary search.
+    template <class T, bool = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>
+    struct btree_search {
+        static const bool enabled = false;
+    };
+
+    template <class T>
+    struct btree_search<T, true> {
+        static const bool enabled = true;
+        //keys left for the linear part.
+        static const size_t WINDOW = 128 / sizeof(T) < 4 ? 4 : 128 / sizeof(T);
+
+        //first i with !(x[i] < key)
+        static size_t lower(const T* x, size_t n, T key) { return __search<false>(x, n, key); }
+        //first i with key < x[i]
+        static size_t upper(const T* x, size_t n, T key) { return __search<true>(x, n, key); }
+
     private:
-        // Your private members go here
+        //0 other, 1 int32, 2 uint32, 3 int64, 4 uint64, 5 float, 6 double
+        typedef std::integral_constant<int, std::is_same<T, float>::value    ? 5
+                                            : std::is_same<T, double>::value ? 6
+                                            : std::is_floating_point<T>::value ? 0
+                                            : sizeof(T) == 4                 ? (std::is_signed<T>::value ? 1 : 2)
+                                            : sizeof(T) == 8                 ? (std::is_signed<T>::value ? 3 : 4)
+                                                                             : 0>
+            kind;
+
+        //x goes before the answer.
+        template <bool Upper>
+        static bool __before(T x, T key) {
+            return Upper ? !(key < x) : x < key;
+        }
+        //The answer stays in [base, base + n] all along.
+        template <bool Upper>
+        static size_t __search(const T* x, size_t n, T key) {
+            const T* base = x;
+            while (n > WINDOW) {
+                size_t half = n >> 1;
+                //both ways the next step can go, a node not in cache would stall every step otherwise.
+                __builtin_prefetch(base + half / 2);
+                __builtin_prefetch(base + half + half / 2);
+                base = __before<Upper>(base[half], key) ? base + half : base;
+                n -= half;
+            }
+            size_t c = 0, i = __count<Upper>(base, n, key, c, kind());
+            for (; i < n; i++)
+                c += __before<Upper>(base[i], key);
+            return base - x + c;
+        }
+        //The kernels add to c how many of the keys they do go before key, and return how many they do.
+        //Compares give -1 in each true lane, which are subtracted into per lane counts.
+        //Upper counts x > key instead and takes it from the total.
+        template <bool Upper, int K>
+        static size_t __count(const T*, size_t, T, size_t&, std::integral_constant<int, K>) {
+            return 0;
+        }
+        template <bool Upper>
+        static size_t __finish(size_t done, size_t hits, size_t& c) {
+            c += Upper ? done - hits : hits;
+            return done;
+        }
+#if defined(__AVX2__)
+        static size_t __sum32(__m256i v) {
+            alignas(32) int32_t lane[8];
+            _mm256_store_si256((__m256i*)lane, v);
+            return lane[0] + lane[1] + lane[2] + lane[3] + lane[4] + lane[5] + lane[6] + lane[7];
+        }
+        static size_t __sum64(__m256i v) {
+            alignas(32) int64_t lane[4];
+            _mm256_store_si256((__m256i*)lane, v);
+            return lane[0] + lane[1] + lane[2] + lane[3];
+        }
+        //unsigned ones are compared as signed after flipping the sign bit.
+        template <bool Upper, int K>
+        static size_t __count_int32(const T* x, size_t n, T key, size_t& c) {
+            const __m256i flip = _mm256_set1_epi32(K == 2 ? (int)0x80000000u : 0);
+            const __m256i k    = _mm256_xor_si256(_mm256_set1_epi32((int)key), flip);
+            __m256i hits       = _mm256_setzero_si256();
+            size_t i           = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(x + i)), flip);
+                hits      = _mm256_sub_epi32(hits, Upper ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v));
+            }
+            return __finish<Upper>(i, __sum32(hits), c);
+        }
+        template <bool Upper, int K>
+        static size_t __count_int64(const T* x, size_t n, T key, size_t& c) {
+            const __m256i flip = _mm256_set1_epi64x(K == 4 ? (long long)0x8000000000000000ull : 0);
+            const __m256i k    = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), flip);
+            __m256i hits       = _mm256_setzero_si256();
+            size_t i           = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(x + i)), flip);
+                hits      = _mm256_sub_epi64(hits, Upper ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v));
+            }
+            return __finish<Upper>(i, __sum64(hits), c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 1>) {
+            return __count_int32<Upper, 1>(x, n, key, c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 2>) {
+            return __count_int32<Upper, 2>(x, n, key, c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 3>) {
+            return __count_int64<Upper, 3>(x, n, key, c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 4>) {
+            return __count_int64<Upper, 4>(x, n, key, c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 5>) {
+            const __m256 k = _mm256_set1_ps((float)key);
+            __m256i hits   = _mm256_setzero_si256();
+            size_t i       = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256 v = _mm256_loadu_ps((const float*)(x + i));
+                __m256 m = Upper ? _mm256_cmp_ps(v, k, _CMP_GT_OQ) : _mm256_cmp_ps(v, k, _CMP_LT_OQ);
+                hits     = _mm256_sub_epi32(hits, _mm256_castps_si256(m));
+            }
+            return __finish<Upper>(i, __sum32(hits), c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 6>) {
+            const __m256d k = _mm256_set1_pd((double)key);
+            __m256i hits    = _mm256_setzero_si256();
+            size_t i        = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m256d v = _mm256_loadu_pd((const double*)(x + i));
+                __m256d m = Upper ? _mm256_cmp_pd(v, k, _CMP_GT_OQ) : _mm256_cmp_pd(v, k, _CMP_LT_OQ);
+                hits      = _mm256_sub_epi64(hits, _mm256_castpd_si256(m));
+            }
+            return __finish<Upper>(i, __sum64(hits), c);
+        }
+#elif defined(__SSE2__)
+        //x86-64 always has SSE2: 32 bit ints, floats and doubles. 64 bit ints need SSE4.2, they stay scalar.
+        static size_t __sum32(__m128i v) {
+            alignas(16) int32_t lane[4];
+            _mm_store_si128((__m128i*)lane, v);
+            return lane[0] + lane[1] + lane[2] + lane[3];
+        }
+        template <bool Upper, int K>
+        static size_t __count_int32(const T* x, size_t n, T key, size_t& c) {
+            const __m128i flip = _mm_set1_epi32(K == 2 ? (int)0x80000000u : 0);
+            const __m128i k    = _mm_xor_si128(_mm_set1_epi32((int)key), flip);
+            __m128i hits       = _mm_setzero_si128();
+            size_t i           = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(x + i)), flip);
+                hits      = _mm_sub_epi32(hits, Upper ? _mm_cmpgt_epi32(v, k) : _mm_cmplt_epi32(v, k));
+            }
+            return __finish<Upper>(i, __sum32(hits), c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 1>) {
+            return __count_int32<Upper, 1>(x, n, key, c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 2>) {
+            return __count_int32<Upper, 2>(x, n, key, c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 5>) {
+            const __m128 k = _mm_set1_ps((float)key);
+            __m128i hits   = _mm_setzero_si128();
+            size_t i       = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128 v = _mm_loadu_ps((const float*)(x + i));
+                __m128 m = Upper ? _mm_cmpgt_ps(v, k) : _mm_cmplt_ps(v, k);
+                hits     = _mm_sub_epi32(hits, _mm_castps_si128(m));
+            }
+            return __finish<Upper>(i, __sum32(hits), c);
+        }
+        template <bool Upper>
+        static size_t __count(const T* x, size_t n, T key, size_t& c, std::integral_constant<int, 6>) {
+            const __m128d k = _mm_set1_pd((double)key);
+            __m128i hits    = _mm_setzero_si128();
+            size_t i        = 0;
+            for (; i + 2 <= n; i += 2) {
+                __m128d v = _mm_loadu_pd((const double*)(x + i));
+                __m128d m = Upper ? _mm_cmpgt_pd(v, k) : _mm_cmplt_pd(v, k);
+                hits      = _mm_sub_epi64(hits, _mm_castpd_si128(m));
+            }
+            alignas(16) int64_t lane[2];
+            _mm_store_si128((__m128i*)lane, hits);
+            return __finish<Upper>(i, lane[0] + lane[1], c);
+        }
+#endif
+    };
+
+    //* Blocked Bloom filter
+    //A key sets K bits in one 512 bit block picked by its hash, so a lookup touches one cache line.
+    //No false negatives; about 1% false positives at 10 bits per key, more once erased keys pile up.
+    class btree_bloom {
+        static const int K = 6;
+        //8 words per block.
+        std::vector<uint64_t> bits;
+
+        static uint64_t __mix(uint64_t h) {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+        size_t __block(uint64_t h) const {
+            return h % (bits.size() / 8) * 8;
+        }
+
     public:
-        BTree() {
+        //keys it was sized for.
+        size_t capacity = 0;
 
+        static uint64_t hash(const char* p, size_t len) {
+            uint64_t h = 0xcbf29ce484222325ULL;
+            for (size_t i = 0; i < len; i++)
+                h = (h ^ (unsigned char)p[i]) * 0x100000001b3ULL;
+            return __mix(h);
+        }
+        void reset(size_t keys) {
+            capacity = keys;
+            bits.assign((keys * __BTREE_BLOOM_BITS__ + 511) / 512 * 8, 0);
+        }
+        bool empty() const { return bits.empty(); }
+        //Bits are set and tested atomically, so add() may run while others call may_contain().
+        void add(uint64_t h) {
+            uint64_t *b = bits.data() + __block(h), g = __mix(h);
+            for (int i = 0; i < K; i++, g >>= 9)
+                __atomic_fetch_or(&b[(g & 511) >> 6], uint64_t(1) << (g & 63), __ATOMIC_RELAXED);
+        }
+        bool may_contain(uint64_t h) const {
+            const uint64_t* b = bits.data() + __block(h);
+            uint64_t g        = __mix(h);
+            for (int i = 0; i < K; i++, g >>= 9)
+                if (!(__atomic_load_n(&b[(g & 511) >> 6], __ATOMIC_RELAXED) >> (g & 63) & 1))
+                    return false;
+            return true;
         }
+        std::vector<uint64_t>& words() { return bits; }
+    };
 
-        BTree(const char *fname) {
+    //* Filter keys
+    //The filter hashes the bytes of a key, lookups go by Compare. Keys that compare equal
+    //with other bytes are brought to one form first: -0.0 and 0.0, also inside a pair.
+    template <class T, bool = std::is_floating_point<T>::value>
+    struct btree_canonical {
+        static const T& get(const T& x) { return x; }
+    };
 
+    template <class T>
+    struct btree_canonical<T, true> {
+        static T get(const T& x) { return x == 0 ? T(0) : x; }
+    };
+
+    template <class T1, class T2>
+    struct btree_canonical<pair<T1, T2>, false> {
+        static pair<T1, T2> get(const pair<T1, T2>& x) {
+            return pair<T1, T2>(btree_canonical<T1>::get(x.first), btree_canonical<T2>::get(x.second));
         }
+    };
 
-        ~BTree() {
+    //* Batched page IO
+    //Reads or writes many pages at once, so the device sees __BTREE_IO_DEPTH__ of them together
+    //instead of one at a time. Goes through io_uring where the kernel allows it,
+    //else hands them to __BTREE_IO_THREADS__ threads doing pread/pwrite.
+    //Both are set up on first use. Several threads may use one btree_io together.
+    class btree_io {
+    public:
+        struct request {
+            long pos;
+            char* buf;
+        };
 
+    private:
+        size_t page;
+        std::once_flag setup, pool_setup;
+
+        //one at a time, for a batch nothing else takes and for requests the ring failed.
+        bool __sync_run(int fd, const request* req, size_t n, bool write) {
+            for (size_t i = 0; i < n; i++) {
+                ssize_t got = write ? pwrite(fd, req[i].buf, page, req[i].pos) : pread(fd, req[i].buf, page, req[i].pos);
+                if (got != (ssize_t)page)
+                    return false;
+            }
+            return true;
+        }
+
+        //pool: jobs of all batches in one queue, each batch counts its own down.
+        struct batch {
+            size_t left;
+            bool failed;
+        };
+        struct job {
+            int fd;
+            bool write;
+            request req;
+            batch* owner;
+        };
+        std::vector<std::thread> workers;
+        std::deque<job> jobs;
+        std::mutex pool_lock;
+        std::condition_variable work, done;
+        bool stop = false;
+
+        void __worker() {
+            std::unique_lock<std::mutex> guard(pool_lock);
+            for (;;) {
+                work.wait(guard, [this] { return stop || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job j = jobs.front();
+                jobs.pop_front();
+                guard.unlock();
+                ssize_t got = j.write ? pwrite(j.fd, j.req.buf, page, j.req.pos) : pread(j.fd, j.req.buf, page, j.req.pos);
+                guard.lock();
+                if (got != (ssize_t)page)
+                    j.owner->failed = true;
+                if (--j.owner->left == 0)
+                    done.notify_all();
+            }
+        }
+        void __start_pool() {
+            for (int i = 0; i < __BTREE_IO_THREADS__; i++)
+                workers.push_back(std::thread(&btree_io::__worker, this));
+        }
+        bool __pool_run(int fd, const request* req, size_t n, bool write) {
+            std::call_once(pool_setup, &btree_io::__start_pool, this);
+            batch b{n, false};
+            std::unique_lock<std::mutex> guard(pool_lock);
+            for (size_t i = 0; i < n; i++)
+                jobs.push_back(job{fd, write, req[i], &b});
+            work.notify_all();
+            done.wait(guard, [&b] { return b.left == 0; });
+            return !b.failed;
+        }
+
+#ifdef __BTREE_IO_URING__
+        int ring = -1;
+        std::atomic<bool> ring_ok{false};
+        std::mutex ring_lock;
+        unsigned entries;
+        unsigned *sq_tail, *sq_mask, *sq_array, *cq_head, *cq_tail, *cq_mask;
+        io_uring_sqe* sqes;
+        io_uring_cqe* cqes;
+        void *sq_ptr = MAP_FAILED, *cq_ptr = MAP_FAILED, *sqe_ptr = MAP_FAILED;
+        size_t sq_len, cq_len, sqe_len;
+
+        //A 5.1-5.5 kernel makes the ring but fails every READ and WRITE with -EINVAL,
+        //and has no probe either.
+        bool __ring_probe() {
+            std::vector<char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+            io_uring_probe* probe = (io_uring_probe*)buf.data();
+            if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, 256) < 0)
+                return false;
+            return probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+                   && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+        }
+        bool __ring_setup() {
+            io_uring_params p;
+            memset(&p, 0, sizeof(p));
+            ring = syscall(__NR_io_uring_setup, __BTREE_IO_DEPTH__, &p);
+            if (ring < 0)
+                return false;
+            entries = p.sq_entries;
+            sq_len  = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+            cq_len  = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+            sqe_len = p.sq_entries * sizeof(io_uring_sqe);
+            if (p.features & IORING_FEAT_SINGLE_MMAP)
+                sq_len = cq_len = std::max(sq_len, cq_len);
+            sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+            if (p.features & IORING_FEAT_SINGLE_MMAP)
+                cq_ptr = sq_ptr;
+            else
+                cq_ptr = mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+            sqe_ptr = mmap(nullptr, sqe_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+            if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqe_ptr == MAP_FAILED || !__ring_probe()) {
+                __ring_close();
+                return false;
+            }
+            char *sq = (char*)sq_ptr, *cq = (char*)cq_ptr;
+            sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+            sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+            sq_array = (unsigned*)(sq + p.sq_off.array);
+            cq_head  = (unsigned*)(cq + p.cq_off.head);
+            cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+            cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+            cqes     = (io_uring_cqe*)(cq + p.cq_off.cqes);
+            sqes     = (io_uring_sqe*)sqe_ptr;
+            ring_ok  = true;
+            return true;
+        }
+        void __ring_close() {
+            if (sqe_ptr != MAP_FAILED)
+                munmap(sqe_ptr, sqe_len);
+            if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+                munmap(cq_ptr, cq_len);
+            if (sq_ptr != MAP_FAILED)
+                munmap(sq_ptr, sq_len);
+            sq_ptr = cq_ptr = sqe_ptr = MAP_FAILED;
+            close(ring);
+            ring    = -1;
+            ring_ok = false;
+        }
+        //Up to entries requests each round: fill the queue, submit them, reap them.
+        //The kernel may take fewer than asked, what it won't take at all is done here.
+        //A request the ring fails is done again with pread/pwrite; if it failed with
+        //-EINVAL or -EOPNOTSUPP the kernel can't do it, and later batches go to the pool.
+        bool __ring_run(int fd, const request* req, size_t n, bool write) {
+            std::lock_guard<std::mutex> guard(ring_lock);
+            bool ok = true;
+            for (size_t i = 0; i < n;) {
+                unsigned k    = std::min(n - i, (size_t)entries);
+                unsigned tail = *sq_tail;
+                for (unsigned j = 0; j < k; j++) {
+                    unsigned idx      = (tail + j) & *sq_mask;
+                    io_uring_sqe* sqe = &sqes[idx];
+                    memset(sqe, 0, sizeof(*sqe));
+                    sqe->opcode    = write ? IORING_OP_WRITE : IORING_OP_READ;
+                    sqe->fd        = fd;
+                    sqe->addr      = (uint64_t)(uintptr_t)req[i + j].buf;
+                    sqe->len       = page;
+                    sqe->off       = req[i + j].pos;
+                    sqe->user_data = j;
+                    sq_array[idx]  = idx;
+                }
+                __atomic_store_n(sq_tail, tail + k, __ATOMIC_RELEASE);
+                //the kernel only waits once all of them are in, and then returns how many went in.
+                unsigned want = k, sent = 0, got = 0;
+                while (got < want) {
+                    long r = syscall(__NR_io_uring_enter, ring, want - sent, want - got, IORING_ENTER_GETEVENTS, nullptr, 0);
+                    if (r > 0 || (r == 0 && sent == want))
+                        sent += r;
+                    else if (r == 0 || (errno != EINTR && !((errno == EAGAIN || errno == EBUSY) && got < sent))) {
+                        //takes no more: take the rest back, the kernel hasn't looked past sent.
+                        __atomic_store_n(sq_tail, tail + sent, __ATOMIC_RELEASE);
+                        ok   = __sync_run(fd, req + i + sent, want - sent, write) && ok;
+                        want = sent;
+                    }
+                    for (unsigned head = *cq_head; head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE); head++) {
+                        int res         = cqes[head & *cq_mask].res;
+                        const request* q = req + i + cqes[head & *cq_mask].user_data;
+                        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                        got++;
+                        if (res == (int)page)
+                            continue;
+                        if (res == -EINVAL || res == -EOPNOTSUPP)
+                            ring_ok = false;
+                        ok = __sync_run(fd, q, 1, write) && ok;
+                    }
+                }
+                i += k;
+            }
+            return ok;
+        }
+#endif
+
+        void __setup() {
+#ifdef __BTREE_IO_URING__
+            __ring_setup();
+#endif
+        }
+        void __run(int fd, const request* req, size_t n, bool write) {
+            if (n == 0)
+                return;
+            std::call_once(setup, &btree_io::__setup, this);
+            bool ok;
+#ifdef __BTREE_IO_URING__
+            if (ring_ok)
+                ok = __ring_run(fd, req, n, write);
+            else
+#endif
+            if (__BTREE_IO_THREADS__ <= 0)
+                ok = __sync_run(fd, req, n, write);
+            else
+                ok = __pool_run(fd, req, n, write);
+            if (!ok)
+                throw runtime_error();
+        }
+
+    public:
+        explicit btree_io(size_t page) : page(page) {}
+        btree_io(const btree_io&) = delete;
+        ~btree_io() {
+            {
+                std::lock_guard<std::mutex> guard(pool_lock);
+                stop = true;
+            }
+            work.notify_all();
+            for (size_t i = 0; i < workers.size(); i++)
+                workers[i].join();
+#ifdef __BTREE_IO_URING__
+            if (ring >= 0)
+                __ring_close();
+#endif
+        }
+        //Each request is one whole page. runtime_error if any of them fails.
+        void read(int fd, const request* req, size_t n) { __run(fd, req, n, false); }
+        void write(int fd, const request* req, size_t n) { __run(fd, req, n, true); }
+    };
+
+    //* Tree latch
+    //Reader/writer latch letting a waiting writer in before readers that come after it,
+    //so a steady stream of readers can't hold it off. Not recursive: a thread holding it
+    //shared must not take it shared again. Usable with std::shared_lock and std::unique_lock.
+    class btree_latch {
+#ifdef __GLIBC__
+        pthread_rwlock_t rw;
+
+    public:
+        btree_latch() {
+            pthread_rwlockattr_t attr;
+            pthread_rwlockattr_init(&attr);
+            pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+            pthread_rwlock_init(&rw, &attr);
+            pthread_rwlockattr_destroy(&attr);
+        }
+        ~btree_latch() { pthread_rwlock_destroy(&rw); }
+        void lock() { pthread_rwlock_wrlock(&rw); }
+        void unlock() { pthread_rwlock_unlock(&rw); }
+        void lock_shared() { pthread_rwlock_rdlock(&rw); }
+        void unlock_shared() { pthread_rwlock_unlock(&rw); }
+#else
+        //readers queue behind any writer already waiting.
+        std::mutex m;
+        std::condition_variable cv;
+        int readers = 0, waiting = 0;
+        bool writer = false;
+
+    public:
+        btree_latch() {}
+        void lock() {
+            std::unique_lock<std::mutex> guard(m);
+            waiting++;
+            cv.wait(guard, [this] { return !writer && readers == 0; });
+            waiting--;
+            writer = true;
+        }
+        void unlock() {
+            std::lock_guard<std::mutex> guard(m);
+            writer = false;
+            cv.notify_all();
+        }
+        void lock_shared() {
+            std::unique_lock<std::mutex> guard(m);
+            cv.wait(guard, [this] { return !writer && waiting == 0; });
+            readers++;
+        }
+        void unlock_shared() {
+            std::lock_guard<std::mutex> guard(m);
+            if (--readers == 0)
+                cv.notify_all();
+        }
+#endif
+        btree_latch(const btree_latch&) = delete;
+        btree_latch& operator=(const btree_latch&) = delete;
+    };
+
+    //* Page latches
+    //Optimistic latches, one per page, kept in a fixed table (pages sharing a slot only retry more):
+    //a version, odd while the writer holds the page and moved on each time it lets go.
+    //Readers take nothing: they read the version before and after copying the page,
+    //and keep the copy only if the version was even and stayed the same.
+    //There is one writer at a time, and only it calls lock() and unlock_all().
+    class btree_versions {
+        static const size_t SLOTS = 4096;
+        std::atomic<uint64_t> version[SLOTS];
+        //how many times the writer took each slot, and the slots it holds.
+        unsigned held[SLOTS];
+        std::vector<size_t> holding;
+
+        static size_t __slot(long pos) {
+            return (size_t)((uint64_t)pos * 0x9e3779b97f4a7c15ULL >> 52);
+        }
+
+    public:
+        btree_versions() {
+            for (size_t i = 0; i < SLOTS; i++) {
+                version[i].store(0, std::memory_order_relaxed);
+                held[i] = 0;
+            }
+        }
+        btree_versions(const btree_versions&) = delete;
+        //Before the writer changes pos in any way. Held until unlock_all().
+        void lock(long pos) {
+            size_t s = __slot(pos);
+            if (held[s]++ == 0) {
+                version[s].fetch_add(1);
+                holding.push_back(s);
+            }
+        }
+        void unlock_all() {
+            for (size_t s : holding) {
+                held[s] = 0;
+                version[s].fetch_add(1, std::memory_order_release);
+            }
+            holding.clear();
+        }
+        //Version to check the read of pos against, once no writer holds it.
+        uint64_t read_begin(long pos) const {
+            const std::atomic<uint64_t>& v = version[__slot(pos)];
+            for (;;) {
+                uint64_t got = v.load(std::memory_order_acquire);
+                if (!(got & 1))
+                    return got;
+                std::this_thread::yield();
+            }
+        }
+        //whether what was read of pos since read_begin() gave v is good.
+        bool read_end(long pos, uint64_t v) const {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return version[__slot(pos)].load(std::memory_order_relaxed) == v;
+        }
+    };
+
+    //* Storage layout:
+    //[meta][page][page][page]...
+    // ^.......offset 0, so 0 is also used as the null page.
+    //Every page starts with a page_header, then
+    //  leaf : plen, the plen bytes all keys start with, then (key without them, value)[size]
+    //         or, with leaf_packed, the keys through btree_packer then value[size]
+    //  inner: child[size + 1], then key[size]
+    //Nodes are filled by bytes, not by count, so short keys give a wider tree.
+    //
+    //Pages given back by merges are reused before the file grows, and compact() gives them
+    //back to the file system. While the tree is open they are kept in memory,
+    //on close they are listed in some of themselves (chain_page) starting from meta.free.
+    //The filter, if any, is also kept in memory and written to a chain of pages on close.
+    //
+    //* Threads:
+    //Reads (at, contains, find, lower_bound, scan, query_batch, iterator steps) and writes
+    //(insert, modify, erase, apply_batch) all share the tree latch; clear() and the steps of
+    //compact() take it alone. Writes go one at a time under their own mutex, and latch each
+    //page (btree_versions) before changing it, until the write is done.
+    //at() and contains() come down the tree with no lock at all, coupling every page they read
+    //with its parent: the child is kept only if neither of them changed meanwhile.
+    //Iterators, scanners and query_batch read a snapshot, whose pages are checked the same way.
+    //Pages are read with pread into the caller's own buffer; the OS page cache is the only cache.
+    //
+    //* Order:
+    //Keys are ordered by Compare, a default constructible strict weak ordering.
+    //Inner pages use shortened separators (btree_codec::separator) and the filter hashes key bytes,
+    //both of which only agree with std::less, so other orders keep whole keys and go without a filter.
+    //
+    //* Sizes:
+    //PageSize is the size of every page, fixed per file. Fanout, if not 0, also caps the entries
+    //of a leaf and the children of an inner node, for fixed size keys whose pages would otherwise
+    //hold more than wanted. Bytes still come first: a node never holds more than fits its page.
+    template <class Key, class Value, class Compare = std::less<Key>,
+              size_t PageSize = __BTREE_PAGE_SIZE__, size_t Fanout = 0>
+    class BTree {
+    public:
+        class iterator;
+        //How leaves store keys, chosen when the file is created.
+        enum leaf_format { leaf_plain,
+                           leaf_packed };
+
+        //* Batched operations
+        enum batch_op_type { batch_insert,
+                             batch_modify,
+                             batch_erase,
+                             batch_query };
+        //result is what the single call would return;
+        //for batch_query, value is filled with at(key).
+        struct batch_op {
+            batch_op_type type;
+            Key key;
+            Value value;
+            bool result;
+        };
+
+    private:
+        typedef btree_codec<Key> key_codec;
+        typedef btree_codec<Value> value_codec;
+        typedef btree_packer<Key> key_packer;
+        static const bool natural_order = std::is_same<Compare, std::less<Key>>::value;
+
+        struct page_header {
+            int size;
+            int leaf;
+            //Siblings, only used by leaves.
+            long prev, next;
+        };
+        //free page lists and the filter.
+        struct chain_page {
+            long next;
+            long count;
+            //then count 8 byte words.
+        };
+        struct meta_page {
+            int magic;
+            //height 1 means the root is a leaf.
+            int height;
+            int format;
+            int filter;
+            long root;
+            long head, tail;
+            //where the next new page goes.
+            long end;
+            size_t size;
+            long free;
+            long bloom;
+            //a file made with another PageSize is refused.
+            long page_size;
+        };
+
+        static const size_t PAGE_SIZE = PageSize;
+        //payload bytes of a page.
+        static const size_t LEAF_CAP  = PAGE_SIZE - sizeof(page_header) - sizeof(uint32_t);
+        static const size_t INNER_CAP = PAGE_SIZE - sizeof(page_header);
+        //largest key + value, small enough that any overflowed inner node splits into two.
+        //Leaves may need more pieces, when the pieces lose the prefix or gaps they shared.
+        static const size_t ENTRY_MAX = INNER_CAP / 4 - sizeof(long);
+        //below these (in bytes) nodes get merged or redistributed.
+        static const size_t LEAF_MIN  = LEAF_CAP / 4;
+        static const size_t INNER_MIN = INNER_CAP / 4;
+        static const size_t CHAIN_CAP = (PAGE_SIZE - sizeof(chain_page)) / sizeof(long);
+        //entries of a plain leaf and children of an inner node with sizeof() sized keys and values,
+        //exact for fixed size types without a shared prefix, a guess otherwise. Nodes reserve this much.
+        static const size_t LEAF_SLOTS  = LEAF_CAP / (sizeof(Key) + sizeof(Value));
+        static const size_t INNER_SLOTS = (INNER_CAP - sizeof(long)) / (sizeof(Key) + sizeof(long)) + 1;
+        //most entries / children a node may have, by count.
+        static const size_t LEAF_MAX  = Fanout ? Fanout : size_t(-1);
+        static const size_t INNER_MAX = Fanout ? Fanout : size_t(-1);
+
+        static_assert(sizeof(meta_page) <= PAGE_SIZE, "page too small for the meta page");
+        static_assert(ENTRY_MAX >= 2 * sizeof(long), "page too small");
+        static_assert(PAGE_SIZE % 512 == 0, "PageSize must be a multiple of 512");
+        static_assert(Fanout == 0 || Fanout >= 4, "Fanout must be 0 or at least 4");
+
+        //In-memory nodes have no fixed capacity,
+        //so merges and batched inserts can overflow them before being split back.
+        struct leaf_node {
+            long prev, next;
+            std::vector<Key> key;
+            std::vector<Value> val;
+        };
+        struct inner_node {
+            std::vector<Key> key;
+            std::vector<long> child;
+        };
+        //Pages and child indexes walked through from the root, for splits and merges.
+        struct trace {
+            long pos[__BTREE_MAX_HEIGHT__];
+            int idx[__BTREE_MAX_HEIGHT__];
+        };
+
+        typedef std::shared_lock<btree_latch> shared_latch;
+        typedef std::unique_lock<btree_latch> exclusive_latch;
+
+        //The tree as it was after some write, pinned by iterators and scanners.
+        struct snapshot {
+            BTree* tree;
+            uint64_t version, epoch;
+            meta_page meta;
+            snapshot(BTree* tree, uint64_t version, uint64_t epoch, const meta_page& meta)
+                : tree(tree), version(version), epoch(epoch), meta(meta) {}
+            ~snapshot() { tree->__unpin(version); }
+        };
+        //What a page held before the write numbered until overwrote it.
+        struct page_copy {
+            uint64_t until;
+            std::vector<char> image;
+        };
+
+        int fd;
+        meta_page meta;
+        std::set<long> free_pages;
+        btree_bloom bloom;
+        mutable btree_io io{PAGE_SIZE};
+        mutable btree_latch latch;
+        //held through every write, see write_scope.
+        mutable std::mutex writing;
+        mutable btree_versions versions;
+        //writes so far, and clear()s so far. Both change under writing.
+        uint64_t version = 0, epoch = 0;
+        //older versions of pages still seen by some snapshot, oldest first.
+        //Snapshot readers look at it while the writer adds to it, hence copy_lock.
+        std::map<long, std::vector<page_copy>> copies;
+        mutable std::mutex copy_lock;
+        //versions of live snapshots. Released from any thread, hence pin_lock.
+        std::multiset<uint64_t> pins;
+        std::mutex pin_lock;
+        bool unpinned = false;
+        //taken from pins when the current write began.
+        bool pinned = false;
+        uint64_t newest = 0;
+
+        //One write, from start to end: writers one at a time, and the pages
+        //it latched let go when it is done, even through an exception.
+        struct write_scope {
+            BTree* tree;
+            std::lock_guard<std::mutex> guard;
+            explicit write_scope(BTree* tree) : tree(tree), guard(tree->writing) { tree->__begin_write(); }
+            ~write_scope() { tree->versions.unlock_all(); }
+        };
+
+        //* Node sizes
+        static size_t __entry_size(const Key& key, const Value& value) {
+            return key_codec::size(key) + value_codec::size(value);
+        }
+        static void __check_entry(const Key& key, const Value& value) {
+            if (__entry_size(key, value) > ENTRY_MAX)
+                throw runtime_error();
+        }
+        //keys are sorted, so what the first and the last share, all share.
+        //Only under std::less: another order may put keys not sharing it between them.
+        static size_t __prefix(const leaf_node& n) {
+            return n.key.empty() || !natural_order ? 0 : key_codec::common(n.key.front(), n.key.back());
+        }
+        static size_t __leaf_raw(const leaf_node& n) {
+            size_t bytes = 0;
+            for (size_t i = 0; i < n.key.size(); i++)
+                bytes += __entry_size(n.key[i], n.val[i]);
+            return bytes;
+        }
+        size_t __leaf_bytes(const leaf_node& n) const {
+            if (meta.format == leaf_packed) {
+                size_t bytes = key_packer::size(n.key.data(), n.key.size());
+                for (size_t i = 0; i < n.val.size(); i++)
+                    bytes += value_codec::size(n.val[i]);
+                return bytes;
+            }
+            size_t plen = __prefix(n), bytes = plen;
+            for (size_t i = 0; i < n.key.size(); i++)
+                bytes += key_codec::size(n.key[i], plen) + value_codec::size(n.val[i]);
+            return bytes;
+        }
+        static size_t __inner_bytes(const inner_node& n) {
+            size_t bytes = sizeof(long) * n.child.size();
+            for (size_t i = 0; i < n.key.size(); i++)
+                bytes += key_codec::size(n.key[i]);
+            return bytes;
+        }
+        bool __leaf_overflow(const leaf_node& n) const {
+            return n.key.size() > LEAF_MAX || __leaf_bytes(n) > LEAF_CAP;
+        }
+        static bool __inner_overflow(const inner_node& n) {
+            return n.child.size() > INNER_MAX || __inner_bytes(n) > INNER_CAP;
+        }
+        //Under a quarter of the page, and with a Fanout, under a quarter of it too;
+        //small keys under a small Fanout never fill a quarter of the page.
+        //An inner node other than the root keeps two children at least, whatever Fanout says.
+        static bool __leaf_underflow(const leaf_node& n) {
+            return __leaf_raw(n) < LEAF_MIN && (Fanout == 0 || n.key.size() < Fanout / 4);
+        }
+        static bool __inner_underflow(const inner_node& n) {
+            return __inner_bytes(n) < INNER_MIN && (Fanout == 0 || n.child.size() < std::max(Fanout / 4, (size_t)2));
+        }
+        //k in [1, n) balancing bytes of [0, k) and [k, n).
+        static size_t __leaf_cut(const leaf_node& n) {
+            size_t total = __leaf_raw(n), left = __entry_size(n.key[0], n.val[0]), k = 1;
+            while (k + 1 < n.key.size()) {
+                size_t next = left + __entry_size(n.key[k], n.val[k]);
+                //moving one more to the left makes it no better.
+                if (std::max(next, total - next) >= std::max(left, total - left))
+                    break;
+                left = next;
+                k++;
+            }
+            //Fanout: left gets at most LEAF_MAX, right as few over it as possible, it is split again.
+            if (Fanout) {
+                size_t count = n.key.size();
+                k = std::min(std::max(k, count > Fanout ? count - Fanout : (size_t)1), (size_t)Fanout);
+            }
+            return k;
+        }
+        //the key going up, balancing keys and children on both sides of it.
+        static size_t __inner_cut(const inner_node& n) {
+            size_t total = __inner_bytes(n), left = sizeof(long), m = 0;
+            //right side of key m: total - left - key m
+            while (m + 1 < n.key.size()) {
+                size_t here = std::max(left, total - left - key_codec::size(n.key[m]));
+                size_t next = left + key_codec::size(n.key[m]) + sizeof(long);
+                if (std::max(next, total - next - key_codec::size(n.key[m + 1])) >= here)
+                    break;
+                left = next;
+                m++;
+            }
+            //Fanout: m + 1 children on the left, key.size() - m on the right.
+            if (Fanout) {
+                size_t keys = n.key.size();
+                m = std::min(std::max(m, keys > Fanout ? keys - Fanout : (size_t)0), (size_t)Fanout - 1);
+            }
+            return m;
+        }
+
+        //* Snapshots
+        //Pages are still written in place. Before a page seen by a live snapshot is overwritten,
+        //the old one is copied aside, tagged with the number of the write doing it.
+        //A snapshot taken after write v reads the first copy tagged past v, or the page itself.
+        //Waits for the write going on, if any, so the snapshot is never taken halfway through one.
+        std::shared_ptr<snapshot> __pin() {
+            std::lock_guard<std::mutex> wait(writing);
+            std::lock_guard<std::mutex> guard(pin_lock);
+            pins.insert(version);
+            return std::make_shared<snapshot>(this, version, epoch, meta);
+        }
+        void __unpin(uint64_t v) {
+            std::lock_guard<std::mutex> guard(pin_lock);
+            pins.erase(pins.find(v));
+            unpinned = true;
+        }
+        //Every write calls this first, holding writing (see write_scope).
+        //No snapshot can be taken until it is done, so pins only get fewer meanwhile.
+        void __begin_write() {
+            version++;
+            std::lock_guard<std::mutex> guard(pin_lock);
+            pinned = !pins.empty();
+            newest = pinned ? *pins.rbegin() : 0;
+            if (unpinned) {
+                unpinned = false;
+                __collect();
+            }
+        }
+        //Drops copies no live snapshot reads. Copy i serves versions [until of copy i-1, until of copy i).
+        void __collect() {
+            std::lock_guard<std::mutex> guard(copy_lock);
+            for (auto it = copies.begin(); it != copies.end();) {
+                std::vector<page_copy>& chain = it->second;
+                uint64_t from = 0;
+                size_t kept   = 0;
+                for (size_t i = 0; i < chain.size(); i++) {
+                    auto p = pins.lower_bound(from);
+                    from   = chain[i].until;
+                    if (p == pins.end() || *p >= chain[i].until)
+                        continue;
+                    if (kept != i)
+                        chain[kept] = std::move(chain[i]);
+                    kept++;
+                }
+                chain.resize(kept);
+                if (chain.empty())
+                    it = copies.erase(it);
+                else
+                    ++it;
+            }
+        }
+        //Called before pos is overwritten or cut off the file.
+        void __preserve(long pos) {
+            if (!pinned)
+                return;
+            auto it = copies.find(pos);
+            //already copied during this write, or rewritten since the newest snapshot.
+            if (it != copies.end() && it->second.back().until > newest)
+                return;
+            page_copy c{version, std::vector<char>(PAGE_SIZE)};
+            //past the end of the file, the page is new to every snapshot.
+            if (pread(fd, c.image.data(), PAGE_SIZE, pos) != (ssize_t)PAGE_SIZE)
+                return;
+            std::lock_guard<std::mutex> guard(copy_lock);
+            copies[pos].push_back(std::move(c));
+        }
+        //Puts what snap sees at pos into buf; false if that is the page itself.
+        //Copied under copy_lock, __collect() may move the images once it is let go.
+        bool __copy_of(long pos, const snapshot* snap, char* buf) const {
+            std::lock_guard<std::mutex> guard(copy_lock);
+            auto it = copies.find(pos);
+            if (it == copies.end())
+                return false;
+            for (const page_copy& c : it->second)
+                if (c.until > snap->version) {
+                    memcpy(buf, c.image.data(), PAGE_SIZE);
+                    return true;
+                }
+            return false;
+        }
+
+        //* Page IO
+        //snap == nullptr reads the current tree, for the writer or whoever holds writing.
+        //Through a snapshot, the page is read again until no write got in the way.
+        void __read_page(long pos, char* buf, const snapshot* snap = nullptr) const {
+            if (snap == nullptr) {
+                if (pread(fd, buf, PAGE_SIZE, pos) != (ssize_t)PAGE_SIZE)
+                    throw runtime_error();
+                return;
+            }
+            for (;;) {
+                uint64_t v = versions.read_begin(pos);
+                if (__copy_of(pos, snap, buf))
+                    return;
+                bool got = pread(fd, buf, PAGE_SIZE, pos) == (ssize_t)PAGE_SIZE;
+                if (versions.read_end(pos, v)) {
+                    if (!got)
+                        throw runtime_error();
+                    return;
+                }
+            }
+        }
+        //Many pages of one snapshot, as __read_page() would, in one batch.
+        void __read_pages(std::vector<btree_io::request>& req, const snapshot* snap) const {
+            std::vector<uint64_t> v(req.size());
+            std::vector<bool> copied(req.size());
+            std::vector<btree_io::request> rest;
+            for (size_t i = 0; i < req.size(); i++) {
+                v[i]      = versions.read_begin(req[i].pos);
+                copied[i] = __copy_of(req[i].pos, snap, req[i].buf);
+                if (!copied[i])
+                    rest.push_back(req[i]);
+            }
+            io.read(fd, rest.data(), rest.size());
+            for (size_t i = 0; i < req.size(); i++)
+                if (!copied[i] && !versions.read_end(req[i].pos, v[i]))
+                    __read_page(req[i].pos, req[i].buf, snap);
+        }
+        void __write_page(long pos, const char* buf) {
+            versions.lock(pos);
+            __preserve(pos);
+            if (pwrite(fd, buf, PAGE_SIZE, pos) != (ssize_t)PAGE_SIZE)
+                throw runtime_error();
+        }
+        void __read_leaf(long pos, leaf_node& n, const snapshot* snap = nullptr) const {
+            char buf[PAGE_SIZE];
+            __read_page(pos, buf, snap);
+            __decode_leaf(buf, n);
+        }
+        void __decode_leaf(const char* buf, leaf_node& n) const {
+            page_header h;
+            uint32_t plen;
+            memcpy(&h, buf, sizeof(h));
+            memcpy(&plen, buf + sizeof(h), sizeof(plen));
+            n.prev             = h.prev;
+            n.next             = h.next;
+            const char* prefix = buf + sizeof(h) + sizeof(plen);
+            const char* p      = prefix + plen;
+            n.key.reserve(std::max((size_t)h.size, (size_t)LEAF_SLOTS) + 1);
+            n.val.reserve(std::max((size_t)h.size, (size_t)LEAF_SLOTS) + 1);
+            n.key.resize(h.size);
+            n.val.resize(h.size);
+            if (meta.format == leaf_packed) {
+                p = key_packer::read(p, n.key.data(), h.size);
+                for (int i = 0; i < h.size; i++)
+                    p = value_codec::read(p, n.val[i]);
+                return;
+            }
+            for (int i = 0; i < h.size; i++) {
+                p = key_codec::read(p, n.key[i], prefix, plen);
+                p = value_codec::read(p, n.val[i]);
+            }
+        }
+        void __write_leaf(long pos, const leaf_node& n) {
+            if (__leaf_overflow(n))
+                throw runtime_error();
+            char buf[PAGE_SIZE];
+            page_header h{(int)n.key.size(), 1, n.prev, n.next};
+            uint32_t plen = meta.format == leaf_packed ? 0 : __prefix(n);
+            memcpy(buf, &h, sizeof(h));
+            memcpy(buf + sizeof(h), &plen, sizeof(plen));
+            char* p = buf + sizeof(h) + sizeof(plen);
+            if (plen > 0) {
+                memcpy(p, key_codec::bytes(n.key[0]), plen);
+                p += plen;
+            }
+            if (meta.format == leaf_packed) {
+                p = key_packer::write(p, n.key.data(), n.key.size());
+                for (size_t i = 0; i < n.val.size(); i++)
+                    p = value_codec::write(p, n.val[i]);
+            } else {
+                for (size_t i = 0; i < n.key.size(); i++) {
+                    p = key_codec::write(p, n.key[i], plen);
+                    p = value_codec::write(p, n.val[i]);
+                }
+            }
+            __write_page(pos, buf);
+        }
+        void __read_inner(long pos, inner_node& n, const snapshot* snap = nullptr) const {
+            char buf[PAGE_SIZE];
+            __read_page(pos, buf, snap);
+            __decode_inner(buf, n);
+        }
+        static void __decode_inner(const char* buf, inner_node& n) {
+            page_header h;
+            memcpy(&h, buf, sizeof(h));
+            const char* p = buf + sizeof(h);
+            n.child.reserve(std::max((size_t)h.size + 1, (size_t)INNER_SLOTS) + 1);
+            n.key.reserve(std::max((size_t)h.size, (size_t)INNER_SLOTS));
+            n.child.resize(h.size + 1);
+            memcpy(n.child.data(), p, sizeof(long) * (h.size + 1));
+            p += sizeof(long) * (h.size + 1);
+            n.key.resize(h.size);
+            for (int i = 0; i < h.size; i++)
+                p = key_codec::read(p, n.key[i]);
+        }
+        void __write_inner(long pos, const inner_node& n) {
+            if (__inner_overflow(n))
+                throw runtime_error();
+            char buf[PAGE_SIZE];
+            page_header h{(int)n.key.size(), 0, 0, 0};
+            memcpy(buf, &h, sizeof(h));
+            char* p = buf + sizeof(h);
+            memcpy(p, n.child.data(), sizeof(long) * n.child.size());
+            p += sizeof(long) * n.child.size();
+            for (size_t i = 0; i < n.key.size(); i++)
+                p = key_codec::write(p, n.key[i]);
+            __write_page(pos, buf);
+        }
+        //relink a leaf without loading it.
+        void __patch_prev(long pos, long prev) {
+            versions.lock(pos);
+            __preserve(pos);
+            if (pwrite(fd, &prev, sizeof(long), pos + offsetof(page_header, prev)) != sizeof(long))
+                throw runtime_error();
+        }
+        void __patch_next(long pos, long next) {
+            versions.lock(pos);
+            __preserve(pos);
+            if (pwrite(fd, &next, sizeof(long), pos + offsetof(page_header, next)) != sizeof(long))
+                throw runtime_error();
+        }
+        //Read by __try_leaf() with no lock, hence atomic and under the latch of page 0.
+        void __set_root(long root, int height) {
+            versions.lock(0);
+            __atomic_store_n(&meta.root, root, __ATOMIC_RELAXED);
+            __atomic_store_n(&meta.height, height, __ATOMIC_RELAXED);
+        }
+        void __write_meta() {
+            char buf[PAGE_SIZE];
+            memset(buf, 0, PAGE_SIZE);
+            memcpy(buf, &meta, sizeof(meta));
+            __write_page(0, buf);
+        }
+        //the lowest free page first, so the end of the file empties out for compact().
+        long __alloc() {
+            if (!free_pages.empty()) {
+                long pos = *free_pages.begin();
+                free_pages.erase(free_pages.begin());
+                return pos;
+            }
+            long pos = meta.end;
+            meta.end += PAGE_SIZE;
+            return pos;
+        }
+        void __free(long pos) {
+            free_pages.insert(pos);
+        }
+        //Free pages are written into trunks taken from themselves, so listing them costs nothing.
+        void __save_free() {
+            std::vector<char> pages;
+            std::vector<long> at;
+            std::vector<long> rest(free_pages.begin(), free_pages.end());
+            meta.free = 0;
+            while (!rest.empty()) {
+                long pos = rest.back();
+                rest.pop_back();
+                pages.resize(pages.size() + PAGE_SIZE);
+                char* buf = pages.data() + pages.size() - PAGE_SIZE;
+                chain_page t{meta.free, (long)std::min(rest.size(), (size_t)CHAIN_CAP)};
+                memcpy(buf, &t, sizeof(t));
+                memcpy(buf + sizeof(t), rest.data() + rest.size() - t.count, sizeof(long) * t.count);
+                rest.resize(rest.size() - t.count);
+                at.push_back(pos);
+                meta.free = pos;
+            }
+            __write_pages(pages, at);
+        }
+        //pages[i * PAGE_SIZE...] goes to at[i], all in one batch.
+        void __write_pages(std::vector<char>& pages, const std::vector<long>& at) {
+            std::vector<btree_io::request> req(at.size());
+            for (size_t i = 0; i < at.size(); i++)
+                req[i] = btree_io::request{at[i], pages.data() + i * PAGE_SIZE};
+            io.write(fd, req.data(), req.size());
+        }
+        void __load_free() {
+            char buf[PAGE_SIZE];
+            free_pages.clear();
+            for (long pos = meta.free; pos != 0;) {
+                chain_page t;
+                __read_page(pos, buf);
+                memcpy(&t, buf, sizeof(t));
+                free_pages.insert(pos);
+                const long* list = (const long*)(buf + sizeof(t));
+                free_pages.insert(list, list + t.count);
+                pos = t.next;
+            }
+        }
+        //Pages of the filter are taken at close and given back at open.
+        void __save_bloom() {
+            std::vector<char> pages;
+            std::vector<long> at;
+            std::vector<uint64_t>& words = bloom.words();
+            meta.bloom = 0;
+            if (!meta.filter)
+                return;
+            //last words first, so the chain starts from the first ones.
+            for (size_t end = words.size(); end > 0;) {
+                size_t begin = end > CHAIN_CAP ? end - CHAIN_CAP : 0;
+                pages.resize(pages.size() + PAGE_SIZE);
+                char* buf = pages.data() + pages.size() - PAGE_SIZE;
+                chain_page t{meta.bloom, (long)(end - begin)};
+                memcpy(buf, &t, sizeof(t));
+                memcpy(buf + sizeof(t), words.data() + begin, sizeof(uint64_t) * t.count);
+                meta.bloom = __alloc();
+                at.push_back(meta.bloom);
+                end = begin;
+            }
+            __write_pages(pages, at);
+        }
+        void __load_bloom() {
+            char buf[PAGE_SIZE];
+            std::vector<uint64_t>& words = bloom.words();
+            words.clear();
+            for (long pos = meta.bloom; pos != 0;) {
+                chain_page t;
+                __read_page(pos, buf);
+                memcpy(&t, buf, sizeof(t));
+                const uint64_t* list = (const uint64_t*)(buf + sizeof(t));
+                words.insert(words.end(), list, list + t.count);
+                __free(pos);
+                pos = t.next;
+            }
+            meta.bloom = 0;
+        }
+
+        //* Filter
+        //Hash of the key as stored in pages, so any type with a codec works,
+        //once equal keys have the same bytes (btree_canonical).
+        //false if it is too large to have been inserted at all.
+        static bool __key_hash(const Key& key, uint64_t& h) {
+            size_t len = key_codec::size(key);
+            if (len > ENTRY_MAX)
+                return false;
+            char buf[ENTRY_MAX];
+            key_codec::write(buf, btree_canonical<Key>::get(key));
+            h = btree_bloom::hash(buf, len);
+            return true;
+        }
+        //false means key is surely not in the tree.
+        bool __may_contain(const Key& key) const {
+            uint64_t h;
+            if (!meta.filter)
+                return true;
+            return __key_hash(key, h) && bloom.may_contain(h);
+        }
+        void __bloom_add(const Key& key) {
+            uint64_t h;
+            if (meta.filter && __key_hash(key, h))
+                bloom.add(h);
+        }
+        //Sized for twice the keys there are now, so it is rebuilt only each time the tree doubles.
+        //Erased keys are dropped here too.
+        void __rebuild_bloom() {
+            bloom.reset(std::max(2 * meta.size, (size_t)1024));
+            leaf_node leaf;
+            for (long pos = meta.head; pos != 0; pos = leaf.next) {
+                __read_leaf(pos, leaf);
+                for (size_t i = 0; i < leaf.key.size(); i++)
+                    __bloom_add(leaf.key[i]);
+            }
+        }
+        bool __bloom_full() const {
+            return meta.filter && meta.size > bloom.capacity;
+        }
+        //Readers test the filter with no lock, so it is only rebuilt with the latch taken alone:
+        //after the write that filled it, not during.
+        void __grow_bloom() {
+            exclusive_latch guard(latch);
+            if (__bloom_full())
+                __rebuild_bloom();
+        }
+        //fresh file: meta page and an empty root leaf.
+        //The file is emptied first, so pages of an earlier tree don't stay behind past end.
+        void __init(int format, int filter) {
+            if (ftruncate(fd, 0) != 0)
+                throw runtime_error();
+            meta.magic  = __BTREE_MAGIC__;
+            meta.page_size = PAGE_SIZE;
+            meta.format = format;
+            meta.filter = filter;
+            meta.bloom  = 0;
+            if (filter)
+                bloom.reset(1024);
+            meta.height = 1;
+            meta.end    = PAGE_SIZE;
+            meta.size   = 0;
+            meta.free   = 0;
+            free_pages.clear();
+            meta.root   = __alloc();
+            meta.head = meta.tail = meta.root;
+            leaf_node root;
+            root.prev = root.next = 0;
+            __write_leaf(meta.root, root);
+            __write_meta();
+        }
+
+        //* Searching
+        static bool __less(const Key& a, const Key& b) {
+            return Compare()(a, b);
+        }
+        static Key __separator(const Key& left, const Key& right) {
+            return natural_order ? key_codec::separator(left, right) : right;
+        }
+        //first index whose key is not less than key.
+        static size_t __lower(const std::vector<Key>& keys, const Key& key) {
+            return __lower(keys, key, std::integral_constant<bool, natural_order && btree_search<Key>::enabled>());
+        }
+        static size_t __lower(const std::vector<Key>& keys, const Key& key, std::true_type) {
+            return btree_search<Key>::lower(keys.data(), keys.size(), key);
+        }
+        static size_t __lower(const std::vector<Key>& keys, const Key& key, std::false_type) {
+            size_t l = 0, r = keys.size();
+            while (l < r) {
+                size_t m = (l + r) >> 1;
+                if (__less(keys[m], key))
+                    l = m + 1;
+                else
+                    r = m;
+            }
+            return l;
+        }
+        //first index whose key is greater than key, i.e. the child to go down.
+        static size_t __upper(const std::vector<Key>& keys, const Key& key) {
+            return __upper(keys, key, std::integral_constant<bool, natural_order && btree_search<Key>::enabled>());
+        }
+        static size_t __upper(const std::vector<Key>& keys, const Key& key, std::true_type) {
+            return btree_search<Key>::upper(keys.data(), keys.size(), key);
+        }
+        static size_t __upper(const std::vector<Key>& keys, const Key& key, std::false_type) {
+            size_t l = 0, r = keys.size();
+            while (l < r) {
+                size_t m = (l + r) >> 1;
+                if (__less(key, keys[m]))
+                    r = m;
+                else
+                    l = m + 1;
+            }
+            return l;
+        }
+        static bool __hit(const leaf_node& n, size_t i, const Key& key) {
+            return i < n.key.size() && !__less(key, n.key[i]);
+        }
+        //walk down to the leaf which may hold key.
+        //hi, if given, is set to the smallest separator bounding the leaf from above;
+        //bounded tells whether there is one (the rightmost leaf has none).
+        //snap, if given, is the tree gone down.
+        long __find_leaf(const Key& key, trace* path = nullptr, Key* hi = nullptr, bool* bounded = nullptr,
+                         const snapshot* snap = nullptr) const {
+            const meta_page& m = snap == nullptr ? meta : snap->meta;
+            long pos           = m.root;
+            if (bounded != nullptr)
+                *bounded = false;
+            inner_node n;
+            for (int level = 0; level < m.height - 1; level++) {
+                __read_inner(pos, n, snap);
+                size_t i = __upper(n.key, key);
+                if (path != nullptr) {
+                    path->pos[level] = pos;
+                    path->idx[level] = i;
+                }
+                if (hi != nullptr && i < n.key.size()) {
+                    *hi      = n.key[i];
+                    *bounded = true;
+                }
+                pos = n.child[i];
+            }
+            return pos;
+        }
+        //exact: end() unless key itself is there, as find() wants.
+        //The snapshot comes first, the iterator then goes down the tree it sees.
+        iterator __lower_bound(const Key& key, bool exact) {
+            std::shared_ptr<snapshot> snap = __pin();
+            long pos                       = __find_leaf(key, nullptr, nullptr, nullptr, snap.get());
+            leaf_node leaf;
+            __read_leaf(pos, leaf, snap.get());
+            size_t i = __lower(leaf.key, key);
+            if (exact && !__hit(leaf, i, key))
+                return end();
+            //past the last key of this leaf, the answer is the first of the next one.
+            if (i == leaf.key.size())
+                return leaf.next == 0 ? end() : iterator(this, snap, leaf.next, 0);
+            return iterator(this, snap, pos, i);
+        }
+
+        //* Optimistic reads
+        //Down to the leaf for key with no lock, see btree_versions. Each page is read, then kept
+        //only if neither it nor its parent changed meanwhile, so it still is the child the parent
+        //names; the root is checked the same way against meta. false if a write got in the way.
+        bool __try_leaf(const Key& key, leaf_node& leaf) const {
+            char buf[PAGE_SIZE];
+            inner_node n;
+            long parent = 0;
+            uint64_t pv = versions.read_begin(0);
+            long pos    = __atomic_load_n(&meta.root, __ATOMIC_RELAXED);
+            int height  = __atomic_load_n(&meta.height, __ATOMIC_RELAXED);
+            for (int level = 0;; level++) {
+                uint64_t v = versions.read_begin(pos);
+                bool got   = pread(fd, buf, PAGE_SIZE, pos) == (ssize_t)PAGE_SIZE;
+                if (!versions.read_end(pos, v) || !versions.read_end(parent, pv))
+                    return false;
+                if (!got)
+                    throw runtime_error();
+                if (level == height - 1) {
+                    __decode_leaf(buf, leaf);
+                    return true;
+                }
+                __decode_inner(buf, n);
+                parent = pos;
+                pv     = v;
+                pos    = n.child[__upper(n.key, key)];
+            }
+        }
+        //After a few tries, wait for the writer and go down as it does.
+        void __shared_leaf(const Key& key, leaf_node& leaf) const {
+            for (int tries = 0; tries < __BTREE_OPTIMISTIC_TRIES__; tries++)
+                if (__try_leaf(key, leaf))
+                    return;
+            std::lock_guard<std::mutex> guard(writing);
+            __read_leaf(__find_leaf(key), leaf);
+        }
+
+        //* Rebalancing
+        //Node sizes are checked here after any change,
+        //overflowed ones get split and underflowed ones get merged or redistributed.
+        void __store_leaf(trace& path, long pos, leaf_node& cur) {
+            if (__leaf_overflow(cur))
+                __split_leaf(path, pos, cur);
+            else if (meta.height > 1 && __leaf_underflow(cur))
+                __rebalance_leaf(path, pos, cur);
+            else
+                __write_leaf(pos, cur);
+        }
+        void __store_inner(trace& path, int level, inner_node& cur) {
+            long pos = path.pos[level];
+            if (__inner_overflow(cur))
+                __split_inner(path, level, cur);
+            else if (level == 0 && cur.key.empty()) {
+                //root left with a single child, the tree shrinks.
+                __set_root(cur.child[0], meta.height - 1);
+                __free(pos);
+            } else if (level > 0 && __inner_underflow(cur))
+                __rebalance_inner(path, level, cur);
+            else
+                __write_inner(pos, cur);
+        }
+        //[0 1 2 3 4 5 6]
+        //       ^--------split():
+        //[0 1 2] [3 4 5 6]
+        //         ^------separator sent to the parent,
+        //                the shortest key between 2 and 3.
+        void __split_leaf(trace& path, long pos, leaf_node& cur) {
+            leaf_node right;
+            size_t k = __leaf_cut(cur);
+            right.key.assign(cur.key.begin() + k, cur.key.end());
+            right.val.assign(cur.val.begin() + k, cur.val.end());
+            cur.key.resize(k);
+            cur.val.resize(k);
+            long rpos  = __alloc();
+            right.prev = pos;
+            right.next = cur.next;
+            if (cur.next != 0)
+                __patch_prev(cur.next, rpos);
+            else
+                meta.tail = rpos;
+            cur.next = rpos;
+            __insert_into_parent(path, meta.height - 2, __separator(cur.key.back(), right.key.front()), rpos);
+            //The right one goes first, a split of the left one relinks its page.
+            __store_piece(rpos, right);
+            __store_piece(pos, cur);
+        }
+        //A piece may still not fit, having lost the prefix or the small gaps it shared.
+        //Such a piece is split again, coming down anew since its parents have changed.
+        void __store_piece(long pos, leaf_node& n) {
+            if (!__leaf_overflow(n)) {
+                __write_leaf(pos, n);
+                return;
+            }
+            trace path;
+            __find_leaf(n.key.front(), &path);
+            __split_leaf(path, pos, n);
+        }
+        //unlike leaves, the middle key moves up instead of being copied.
+        void __split_inner(trace& path, int level, inner_node& cur) {
+            inner_node right;
+            size_t m = __inner_cut(cur);
+            Key up   = cur.key[m];
+            right.key.assign(cur.key.begin() + m + 1, cur.key.end());
+            right.child.assign(cur.child.begin() + m + 1, cur.child.end());
+            cur.key.resize(m);
+            cur.child.resize(m + 1);
+            long rpos = __alloc();
+            __write_inner(path.pos[level], cur);
+            __write_inner(rpos, right);
+            __insert_into_parent(path, level - 1, up, rpos);
+        }
+        //put separator key and the new right page after path.idx[level].
+        void __insert_into_parent(trace& path, int level, const Key& key, long right) {
+            inner_node par;
+            if (level < 0) {
+                //root split, grow up.
+                if (meta.height >= __BTREE_MAX_HEIGHT__)
+                    throw runtime_error();
+                par.key.push_back(key);
+                par.child.push_back(meta.root);
+                par.child.push_back(right);
+                long root = __alloc();
+                __write_inner(root, par);
+                __set_root(root, meta.height + 1);
+                return;
+            }
+            __read_inner(path.pos[level], par);
+            int i = path.idx[level];
+            par.key.insert(par.key.begin() + i, key);
+            par.child.insert(par.child.begin() + i + 1, right);
+            __store_inner(path, level, par);
+        }
+        //drop key[i] and child[i + 1], after child i + 1 is merged into child i.
+        static void __remove_from_inner(inner_node& n, int i) {
+            n.key.erase(n.key.begin() + i);
+            n.child.erase(n.child.begin() + i + 1);
+        }
+        //Pull everything into the left one of the pair,
+        //then either keep it merged or cut it in the middle again.
+        void __rebalance_leaf(trace& path, long pos, leaf_node& cur) {
+            int level = meta.height - 2;
+            inner_node par;
+            leaf_node sib;
+            __read_inner(path.pos[level], par);
+            int i = path.idx[level], s;
+            long lpos, rpos;
+            leaf_node *l, *r;
+            if (i > 0) {
+                s    = i - 1;
+                lpos = par.child[s];
+                rpos = pos;
+                __read_leaf(lpos, sib);
+                l = &sib;
+                r = &cur;
+            } else {
+                s    = 0;
+                lpos = pos;
+                rpos = par.child[1];
+                __read_leaf(rpos, sib);
+                l = &cur;
+                r = &sib;
+            }
+            leaf_node all = *l;
+            all.key.insert(all.key.end(), r->key.begin(), r->key.end());
+            all.val.insert(all.val.end(), r->val.begin(), r->val.end());
+            if (!__leaf_overflow(all)) {
+                all.next = r->next;
+                if (r->next != 0)
+                    __patch_prev(r->next, lpos);
+                else
+                    meta.tail = lpos;
+                __write_leaf(lpos, all);
+                __free(rpos);
+                __remove_from_inner(par, s);
+            } else {
+                size_t k       = __leaf_cut(all);
+                leaf_node half = *r;
+                half.key.assign(all.key.begin() + k, all.key.end());
+                half.val.assign(all.val.begin() + k, all.val.end());
+                all.key.resize(k);
+                all.val.resize(k);
+                //Too much to share between two pages, which only happens when
+                //the sibling is packed tight by its prefix or gaps. Leave it underfull.
+                if (__leaf_overflow(all) || __leaf_overflow(half)) {
+                    __write_leaf(pos, cur);
+                    return;
+                }
+                par.key[s] = __separator(all.key.back(), half.key.front());
+                __write_leaf(lpos, all);
+                __write_leaf(rpos, half);
+            }
+            //the separator may have changed length too.
+            __store_inner(path, level, par);
+        }
+        void __rebalance_inner(trace& path, int level, inner_node& cur) {
+            long pos = path.pos[level];
+            inner_node par, sib;
+            __read_inner(path.pos[level - 1], par);
+            int i = path.idx[level - 1], s;
+            long lpos, rpos;
+            inner_node *l, *r;
+            if (i > 0) {
+                s    = i - 1;
+                lpos = par.child[s];
+                rpos = pos;
+                __read_inner(lpos, sib);
+                l = &sib;
+                r = &cur;
+            } else {
+                s    = 0;
+                lpos = pos;
+                rpos = par.child[1];
+                __read_inner(rpos, sib);
+                l = &cur;
+                r = &sib;
+            }
+            //the separator comes down between them.
+            l->key.push_back(par.key[s]);
+            l->key.insert(l->key.end(), r->key.begin(), r->key.end());
+            l->child.insert(l->child.end(), r->child.begin(), r->child.end());
+            if (!__inner_overflow(*l)) {
+                __write_inner(lpos, *l);
+                __free(rpos);
+                __remove_from_inner(par, s);
+            } else {
+                size_t m   = __inner_cut(*l);
+                par.key[s] = l->key[m];
+                r->key.assign(l->key.begin() + m + 1, l->key.end());
+                r->child.assign(l->child.begin() + m + 1, l->child.end());
+                l->key.resize(m);
+                l->child.resize(m + 1);
+                __write_inner(lpos, *l);
+                __write_inner(rpos, *r);
+            }
+            __store_inner(path, level - 1, par);
+        }
+
+        //* Batched queries
+        //order[0, n) are sorted by key. Each group is a page of the current level
+        //with the run of ops going through it.
+        void __query_chunk(batch_op* ops, const size_t* order, size_t n, const snapshot* snap) const {
+            struct group {
+                long pos;
+                size_t l, r;
+            };
+            std::vector<group> cur(1, group{snap->meta.root, 0, n}), next;
+            std::vector<char> pages;
+            std::vector<btree_io::request> req;
+            inner_node node;
+            for (int level = 0;; level++) {
+                pages.resize(cur.size() * PAGE_SIZE);
+                req.resize(cur.size());
+                for (size_t g = 0; g < cur.size(); g++)
+                    req[g] = btree_io::request{cur[g].pos, pages.data() + g * PAGE_SIZE};
+                __read_pages(req, snap);
+                if (level == snap->meta.height - 1)
+                    break;
+                next.clear();
+                for (size_t g = 0; g < cur.size(); g++) {
+                    __decode_inner(pages.data() + g * PAGE_SIZE, node);
+                    for (size_t i = cur[g].l, j; i < cur[g].r; i = j) {
+                        size_t c = __upper(node.key, ops[order[i]].key);
+                        //the ones after it up to key[c] go the same way.
+                        for (j = i + 1; j < cur[g].r && (c == node.key.size() || __less(ops[order[j]].key, node.key[c])); j++)
+                            ;
+                        next.push_back(group{node.child[c], i, j});
+                    }
+                }
+                cur.swap(next);
+            }
+            leaf_node leaf;
+            for (size_t g = 0; g < cur.size(); g++) {
+                __decode_leaf(pages.data() + g * PAGE_SIZE, leaf);
+                for (size_t i = cur[g].l; i < cur[g].r; i++) {
+                    batch_op& op = ops[order[i]];
+                    size_t k     = __lower(leaf.key, op.key);
+                    if (__hit(leaf, k, op.key)) {
+                        op.result = true;
+                        op.value  = leaf.val[k];
+                    }
+                }
+            }
+        }
+
+        //* Compaction
+        //One leaf of compact()'s first pass: a leaf less than half full is merged into,
+        //or shares with, a neighbour. key moves on to the first key of the next leaf.
+        bool __compact_leaf(Key& key) {
+            trace path;
+            long pos = __find_leaf(key, &path);
+            leaf_node leaf;
+            __read_leaf(pos, leaf);
+            if (meta.height > 1 && __leaf_bytes(leaf) < LEAF_CAP / 2 && (Fanout == 0 || leaf.key.size() < Fanout / 2))
+                __rebalance_leaf(path, pos, leaf);
+            __read_leaf(__find_leaf(key), leaf);
+            if (leaf.next == 0)
+                return false;
+            __read_leaf(leaf.next, leaf);
+            key = leaf.key.front();
+            return true;
+        }
+        //Put the page at top into the free page dst, fixing whoever points to it.
+        void __move_page(long top, long dst) {
+            char buf[PAGE_SIZE];
+            page_header h;
+            __read_page(top, buf);
+            __write_page(dst, buf);
+            memcpy(&h, buf, sizeof(h));
+            if (h.leaf) {
+                if (h.prev != 0)
+                    __patch_next(h.prev, dst);
+                else
+                    meta.head = dst;
+                if (h.next != 0)
+                    __patch_prev(h.next, dst);
+                else
+                    meta.tail = dst;
+            }
+            if (top == meta.root) {
+                __set_root(dst, meta.height);
+                return;
+            }
+            //its parent is on the way down to its first key.
+            Key key;
+            if (h.leaf) {
+                leaf_node n;
+                __read_leaf(dst, n);
+                key = n.key.front();
+            } else {
+                inner_node n;
+                __read_inner(dst, n);
+                key = n.key.front();
+            }
+            long pos = meta.root;
+            inner_node n;
+            for (int level = 0; level < meta.height - 1; level++) {
+                __read_inner(pos, n);
+                size_t i = __upper(n.key, key);
+                if (n.child[i] == top) {
+                    n.child[i] = dst;
+                    __write_inner(pos, n);
+                    return;
+                }
+                pos = n.child[i];
+            }
+            throw runtime_error();
+        }
+        //Second pass: empty the end of the file, at most step pages at a time.
+        //false once no free page is left.
+        bool __compact_tail(int step) {
+            for (; step > 0 && !free_pages.empty(); step--) {
+                long top  = meta.end - PAGE_SIZE;
+                auto last = std::prev(free_pages.end());
+                __preserve(top);
+                if (*last == top)
+                    free_pages.erase(last);
+                else {
+                    long dst = *free_pages.begin();
+                    free_pages.erase(free_pages.begin());
+                    __move_page(top, dst);
+                }
+                meta.end = top;
+            }
+            if (ftruncate(fd, meta.end) != 0)
+                throw runtime_error();
+            return !free_pages.empty();
+        }
+
+    public:
+        BTree() : BTree("BTree.dat") {}
+
+        //format only matters for a new file, an existing one keeps its own.
+        //runtime_error if the file is not empty and not a tree of this PageSize.
+        //leaf_packed needs integer keys and is ignored for others.
+        //With filter, at() and find() answer most missing keys from a Bloom filter,
+        //without reading any page. It is kept with the file, so later opens may leave it out.
+        //It is ignored unless Compare is std::less<Key>.
+        BTree(const char *fname, leaf_format format = leaf_plain, bool filter = false) {
+            fd = open(fname, O_RDWR | O_CREAT, 0644);
+            if (fd < 0)
+                throw runtime_error();
+            //Only an empty file becomes a new tree. Anything else not made by a BTree
+            //with this PageSize is left as it is.
+            ssize_t got = pread(fd, &meta, sizeof(meta), 0);
+            if (got == 0) {
+                __init(key_packer::enabled ? format : leaf_plain, filter && natural_order);
+                versions.unlock_all();
+                return;
+            }
+            if (got != sizeof(meta) || meta.magic != __BTREE_MAGIC__ || meta.page_size != (long)PAGE_SIZE) {
+                close(fd);
+                throw runtime_error();
+            }
+            __load_free();
+            __load_bloom();
+            if (filter && natural_order && !meta.filter) {
+                meta.filter = 1;
+                __rebuild_bloom();
+            }
+        }
+
+        BTree(const BTree&) = delete;
+        BTree& operator=(const BTree&) = delete;
+
+        //Never throws. A filter that can't be written is dropped and rebuilt by the next open
+        //asking for one, a free list that can't be written leaks its pages.
+        ~BTree() {
+            try {
+                __save_bloom();
+            } catch (...) {
+                meta.bloom  = 0;
+                meta.filter = 0;
+            }
+            try {
+                __save_free();
+            } catch (...) {
+                meta.free = 0;
+            }
+            try {
+                __write_meta();
+            } catch (...) {
+            }
+            close(fd);
         }
 
         // Clear the BTree
+        //Iterators and scanners taken before it throw invalid_iterator afterwards.
         void clear() {
+            exclusive_latch guard(latch);
+            write_scope scope(this);
+            epoch++;
+            {
+                std::lock_guard<std::mutex> copy_guard(copy_lock);
+                copies.clear();
+            }
+            __init(meta.format, meta.filter);
+        }
 
+        //Packs leaves less than half full together, then moves pages from the end of the file
+        //into the free ones and truncates it, so the file holds no free page afterwards.
+        //The latch is taken alone for __BTREE_COMPACT_STEP__ pages at a time,
+        //so it may run in its own thread while the tree is in use.
+        void compact() {
+            Key key;
+            bool more;
+            {
+                exclusive_latch guard(latch);
+                leaf_node head;
+                __read_leaf(meta.head, head);
+                more = !head.key.empty();
+                if (more)
+                    key = head.key.front();
+            }
+            while (more) {
+                exclusive_latch guard(latch);
+                write_scope scope(this);
+                for (int step = 0; more && step < __BTREE_COMPACT_STEP__; step++)
+                    more = __compact_leaf(key);
+            }
+            do {
+                exclusive_latch guard(latch);
+                write_scope scope(this);
+                more = __compact_tail(__BTREE_COMPACT_STEP__);
+            } while (more);
+            exclusive_latch guard(latch);
+            if (meta.filter)
+                __rebuild_bloom();
         }
 
+        //Keys and values larger than about a quarter page are refused with runtime_error.
         bool insert(const Key &key, const Value &value) {
-
+            __check_entry(key, value);
+            bool full;
+            {
+                shared_latch guard(latch);
+                write_scope scope(this);
+                trace path;
+                long pos = __find_leaf(key, &path);
+                leaf_node leaf;
+                __read_leaf(pos, leaf);
+                size_t i = __lower(leaf.key, key);
+                if (__hit(leaf, i, key))
+                    return false;
+                leaf.key.insert(leaf.key.begin() + i, key);
+                leaf.val.insert(leaf.val.begin() + i, value);
+                meta.size++;
+                __store_leaf(path, pos, leaf);
+                __bloom_add(key);
+                full = __bloom_full();
+            }
+            if (full)
+                __grow_bloom();
+            return true;
         }
 
         bool modify(const Key &key, const Value &value) {
-
+            __check_entry(key, value);
+            shared_latch guard(latch);
+            write_scope scope(this);
+            trace path;
+            long pos = __find_leaf(key, &path);
+            leaf_node leaf;
+            __read_leaf(pos, leaf);
+            size_t i = __lower(leaf.key, key);
+            if (!__hit(leaf, i, key))
+                return false;
+            //a value of another length may overflow or underflow the leaf.
+            leaf.val[i] = value;
+            __store_leaf(path, pos, leaf);
+            return true;
         }
 
         Value at(const Key &key) {
+            shared_latch guard(latch);
+            if (!__may_contain(key))
+                return Value();
+            leaf_node leaf;
+            __shared_leaf(key, leaf);
+            size_t i = __lower(leaf.key, key);
+            return __hit(leaf, i, key) ? leaf.val[i] : Value();
+        }
 
+        //like find(key) != end(), without taking a snapshot.
+        bool contains(const Key &key) {
+            shared_latch guard(latch);
+            if (!__may_contain(key))
+                return false;
+            leaf_node leaf;
+            __shared_leaf(key, leaf);
+            return __hit(leaf, __lower(leaf.key, key), key);
+        }
+        //whether insert / modify would take them, see ENTRY_MAX.
+        static bool fits(const Key &key, const Value &value) {
+            return __entry_size(key, value) <= ENTRY_MAX;
         }
 
         bool erase(const Key &key) {
-            
+            shared_latch guard(latch);
+            write_scope scope(this);
+            trace path;
+            long pos = __find_leaf(key, &path);
+            leaf_node leaf;
+            __read_leaf(pos, leaf);
+            size_t i = __lower(leaf.key, key);
+            if (!__hit(leaf, i, key))
+                return false;
+            leaf.key.erase(leaf.key.begin() + i);
+            leaf.val.erase(leaf.val.begin() + i);
+            meta.size--;
+            __store_leaf(path, pos, leaf);
+            return true;
+        }
+
+        //Same results as calling them one by one in the given order,
+        //but ops are sorted by key first (stable, so ops on one key keep their order),
+        //each touched leaf is read and written once,
+        //and its split or merge is done once after all of its ops.
+        void apply_batch(batch_op* ops, size_t n) {
+            if (n == 0)
+                return;
+            for (size_t i = 0; i < n; i++)
+                if (ops[i].type == batch_insert || ops[i].type == batch_modify)
+                    __check_entry(ops[i].key, ops[i].value);
+            std::vector<size_t> order(n);
+            for (size_t i = 0; i < n; i++)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [ops](size_t a, size_t b) { return __less(ops[a].key, ops[b].key); });
+            bool full;
+            {
+                shared_latch guard(latch);
+                write_scope scope(this);
+                leaf_node leaf;
+                size_t i = 0;
+                while (i < n) {
+                    //a query for a missing key needs no leaf, unless the leaf is read anyway.
+                    batch_op& first = ops[order[i]];
+                    if (first.type == batch_query && !__may_contain(first.key)) {
+                        first.result = false;
+                        first.value  = Value();
+                        i++;
+                        continue;
+                    }
+                    trace path;
+                    Key hi;
+                    bool bounded;
+                    long pos = __find_leaf(ops[order[i]].key, &path, &hi, &bounded);
+                    __read_leaf(pos, leaf);
+                    size_t raw = __leaf_raw(leaf);
+                    bool dirty = false;
+                    for (; i < n; i++) {
+                        batch_op& op = ops[order[i]];
+                        //belongs to a later leaf.
+                        if (bounded && !__less(op.key, hi))
+                            break;
+                        size_t k = __lower(leaf.key, op.key);
+                        bool hit = __hit(leaf, k, op.key);
+                        //in-memory leaf grown past two pages (before compression), flush and come down again.
+                        size_t grow = 0;
+                        if (op.type == batch_insert && !hit)
+                            grow = __entry_size(op.key, op.value);
+                        else if (op.type == batch_modify && hit)
+                            grow = value_codec::size(op.value);
+                        if (dirty && (raw + grow > 2 * LEAF_CAP || leaf.key.size() >= 2 * LEAF_MAX))
+                            break;
+                        switch (op.type) {
+                        case batch_insert:
+                            op.result = !hit;
+                            if (hit)
+                                break;
+                            leaf.key.insert(leaf.key.begin() + k, op.key);
+                            leaf.val.insert(leaf.val.begin() + k, op.value);
+                            __bloom_add(op.key);
+                            raw += grow;
+                            meta.size++;
+                            dirty = true;
+                            break;
+                        case batch_modify:
+                            op.result = hit;
+                            if (!hit)
+                                break;
+                            raw         = raw + grow - value_codec::size(leaf.val[k]);
+                            leaf.val[k] = op.value;
+                            dirty       = true;
+                            break;
+                        case batch_erase:
+                            op.result = hit;
+                            if (!hit)
+                                break;
+                            raw -= __entry_size(leaf.key[k], leaf.val[k]);
+                            leaf.key.erase(leaf.key.begin() + k);
+                            leaf.val.erase(leaf.val.begin() + k);
+                            meta.size--;
+                            dirty = true;
+                            break;
+                        case batch_query:
+                            op.result = hit;
+                            op.value  = hit ? leaf.val[k] : Value();
+                            break;
+                        }
+                    }
+                    if (dirty)
+                        __store_leaf(path, pos, leaf);
+                    //readers may have the leaves done so far.
+                    versions.unlock_all();
+                }
+                full = __bloom_full();
+            }
+            if (full)
+                __grow_bloom();
+        }
+
+        //Like apply_batch with only batch_query ops (type is not looked at),
+        //but as a reader, on a snapshot. The ops come down the tree together, a level at a time,
+        //and all pages of a level are read as one batch, so the device works on many at once.
+        void query_batch(batch_op* ops, size_t n) {
+            shared_latch guard(latch);
+            std::vector<size_t> order;
+            order.reserve(n);
+            for (size_t i = 0; i < n; i++) {
+                ops[i].result = false;
+                ops[i].value  = Value();
+                if (__may_contain(ops[i].key))
+                    order.push_back(i);
+            }
+            std::stable_sort(order.begin(), order.end(), [ops](size_t a, size_t b) { return __less(ops[a].key, ops[b].key); });
+            //a bounded number of pages in memory at once.
+            const size_t chunk = 32 * __BTREE_IO_DEPTH__;
+            if (order.empty())
+                return;
+            std::shared_ptr<snapshot> snap = __pin();
+            for (size_t i = 0; i < order.size(); i += chunk)
+                __query_chunk(ops, order.data() + i, std::min(chunk, order.size() - i), snap.get());
+        }
+
+        size_t size() const {
+            shared_latch guard(latch);
+            std::lock_guard<std::mutex> wait(writing);
+            return meta.size;
         }
-        
-        
+        bool empty() const { return size() == 0; }
+
+        //An iterator sees the tree as it was when find(), lower_bound() or begin() made it,
+        //whatever is written meanwhile. It keeps the leaf it is on, so stepping inside it
+        //and reading keys and values take no latch.
         class iterator {
+            friend class BTree;
+
         private:
-            // Your private members go here
+            BTree* tree;
+            //null only for end() straight from the tree, pinned on the first --.
+            std::shared_ptr<snapshot> snap;
+            std::shared_ptr<const leaf_node> leaf;
+            //leaf page and index in it. pos == 0 is end().
+            long pos;
+            int idx;
+            //The caller holds the latch.
+            iterator(BTree* tree, const std::shared_ptr<snapshot>& snap, long pos, int idx)
+                : tree(tree), snap(snap), pos(pos), idx(idx) {
+                if (pos != 0)
+                    __load();
+            }
+            void __load() {
+                if (snap->epoch != tree->epoch)
+                    throw invalid_iterator();
+                std::shared_ptr<leaf_node> n = std::make_shared<leaf_node>();
+                tree->__read_leaf(pos, *n, snap.get());
+                leaf = n;
+            }
+
         public:
-            iterator() {
-                
+            iterator() : tree(nullptr), pos(0), idx(0) {
+
             }
-            iterator(const iterator& other) {
-                
+            iterator(const iterator& other) : tree(other.tree), snap(other.snap), leaf(other.leaf), pos(other.pos), idx(other.idx) {
+
             }
 
             // modify by iterator
+            //Afterwards the iterator sees the tree as of this change.
             bool modify(const Value& value) {
-                
+                if (tree == nullptr || pos == 0)
+                    return false;
+                Key key = getKey();
+                //the value may change length, so go through the tree.
+                if (!tree->modify(key, value))
+                    return false;
+                shared_latch guard(tree->latch);
+                *this = tree->__lower_bound(key, true);
+                return true;
             }
 
             Key getKey() const {
-
+                if (tree == nullptr || pos == 0)
+                    throw invalid_iterator();
+                return leaf->key[idx];
             }
 
             Value getValue() const {
-
+                if (tree == nullptr || pos == 0)
+                    throw invalid_iterator();
+                return leaf->val[idx];
             }
 
             iterator operator++(int) {
-
+                iterator it(*this);
+                ++(*this);
+                return it;
             }
 
             iterator& operator++() {
-                
+                if (tree == nullptr || pos == 0)
+                    throw invalid_iterator();
+                if (++idx < (int)leaf->key.size())
+                    return *this;
+                pos = leaf->next;
+                idx = 0;
+                leaf.reset();
+                if (pos != 0) {
+                    shared_latch guard(tree->latch);
+                    __load();
+                }
+                return *this;
             }
             iterator operator--(int) {
-                
+                iterator it(*this);
+                --(*this);
+                return it;
             }
 
             iterator& operator--() {
-                
+                if (tree == nullptr)
+                    throw invalid_iterator();
+                if (idx > 0) {
+                    idx--;
+                    return *this;
+                }
+                shared_latch guard(tree->latch);
+                if (!snap)
+                    snap = tree->__pin();
+                //begin() can't go back, neither can end() of an empty tree.
+                long prev = pos == 0 ? snap->meta.tail : leaf->prev;
+                if (prev == 0 || snap->meta.size == 0)
+                    throw invalid_iterator();
+                pos = prev;
+                __load();
+                idx = leaf->key.size() - 1;
+                return *this;
             }
 
             // Overloaded of operator '==' and '!='
             // Check whether the iterators are same
             bool operator==(const iterator& rhs) const {
-                
+                return tree == rhs.tree && pos == rhs.pos && idx == rhs.idx;
             }
 
             bool operator!=(const iterator& rhs) const {
-                
+                return !(*this == rhs);
             }
         };
-        
-        iterator begin() {
 
+        //Hands out [lo, hi) one leaf at a time, see scan().
+        //Like iterators, it sees the tree as it was when scan() made it.
+        class scanner {
+            friend class BTree;
+
+        private:
+            BTree* tree;
+            std::shared_ptr<snapshot> snap;
+            int height;
+            Key lo, hi;
+            int ahead;
+            //next leaf to read, 0 when done.
+            long pos;
+            bool first;
+            //path down to pos. par is its parent (when height > 1),
+            //and its children up to advised are already read ahead.
+            trace path;
+            inner_node par;
+            int advised;
+
+            scanner(BTree* tree, const Key& lo, const Key& hi, int ahead)
+                : tree(tree), snap(tree->__pin()), height(snap->meta.height),
+                  lo(lo), hi(hi), ahead(ahead), pos(0), first(true), advised(-1) {
+                if (!__less(lo, hi))
+                    return;
+                pos = tree->__find_leaf(lo, &path, nullptr, nullptr, snap.get());
+                if (height > 1) {
+                    tree->__read_inner(path.pos[height - 2], par, snap.get());
+                    __readahead();
+                }
+            }
+            //Tell the OS about the siblings coming next, it reads them while we work.
+            //Children whose keys all come at or after hi are left alone.
+            void __readahead() {
+                int idx  = path.idx[height - 2];
+                int last = std::min(idx + ahead, (int)par.key.size());
+                for (int j = std::max(advised + 1, idx + 1); j <= last && __less(par.key[j - 1], hi); j++) {
+#ifdef POSIX_FADV_WILLNEED
+                    posix_fadvise(tree->fd, par.child[j], PAGE_SIZE, POSIX_FADV_WILLNEED);
+#endif
+                    advised = j;
+                }
+            }
+            //step path and pos to the next leaf, or pos = 0 if it starts at or after hi.
+            void __advance() {
+                int bottom = height - 2, level = bottom;
+                pos        = 0;
+                if (bottom < 0)
+                    return;
+                inner_node n;
+                //lowest level not at its last child yet.
+                for (; level >= 0; level--) {
+                    if (level < bottom)
+                        tree->__read_inner(path.pos[level], n, snap.get());
+                    const inner_node& cur = level == bottom ? par : n;
+                    if (path.idx[level] < (int)cur.key.size()) {
+                        if (!__less(cur.key[path.idx[level]], hi))
+                            return;
+                        path.idx[level]++;
+                        break;
+                    }
+                }
+                if (level < 0)
+                    return;
+                //and down the leftmost way to the parent of the new leaf.
+                if (level < bottom) {
+                    for (level++; level <= bottom; level++) {
+                        path.pos[level] = n.child[path.idx[level - 1]];
+                        path.idx[level] = 0;
+                        tree->__read_inner(path.pos[level], n, snap.get());
+                    }
+                    par     = n;
+                    advised = -1;
+                }
+                pos = par.child[path.idx[bottom]];
+                __readahead();
+            }
+
+        public:
+            //Fills batch with the next run of pairs, all from one leaf.
+            //false (and batch empty) once the range is done.
+            bool next(std::vector<pair<Key, Value>>& batch) {
+                batch.clear();
+                if (pos == 0)
+                    return false;
+                shared_latch guard(tree->latch);
+                if (snap->epoch != tree->epoch)
+                    throw invalid_iterator();
+                leaf_node leaf;
+                while (batch.empty() && pos != 0) {
+                    tree->__read_leaf(pos, leaf, snap.get());
+                    size_t i = first ? __lower(leaf.key, lo) : 0;
+                    first    = false;
+                    for (; i < leaf.key.size() && __less(leaf.key[i], hi); i++)
+                        batch.emplace_back(leaf.key[i], leaf.val[i]);
+                    if (i < leaf.key.size())
+                        pos = 0;
+                    else
+                        __advance();
+                }
+                return !batch.empty();
+            }
+        };
+
+        iterator begin() {
+            shared_latch guard(latch);
+            std::shared_ptr<snapshot> snap = __pin();
+            return snap->meta.size == 0 ? end() : iterator(this, snap, snap->meta.head, 0);
         }
-        
+
         // return an iterator to the end(the next element after the last)
         iterator end() {
-
+            return iterator(this, nullptr, 0, 0);
         }
 
         iterator find(const Key &key) {
-        
+            shared_latch guard(latch);
+            if (!__may_contain(key))
+                return end();
+            return __lower_bound(key, true);
         }
-        
+
         // return an iterator whose key is the smallest key greater or equal than 'key'
         iterator lower_bound(const Key &key) {
-            
+            shared_latch guard(latch);
+            return __lower_bound(key, false);
+        }
+
+        //Range scan over [lo, hi) for reading many keys at once:
+        //    auto sc = tree.scan(lo, hi);
+        //    std::vector<sjtu::pair<Key, Value>> batch;
+        //    while (sc.next(batch)) ...
+        //While a leaf is handed out, the next ahead ones are being read in the background.
+        scanner scan(const Key &lo, const Key &hi, int ahead = __BTREE_READAHEAD__) {
+            shared_latch guard(latch);
+            return scanner(this, lo, hi, ahead);
         }
     };
-}  // namespace sjtu
 
+    //* Secondary indexes
+    //An entry of BTreeIndex. probe is not stored: -1 and 1 make search keys
+    //that come before and after every id of key.
+    template <class Key, class RowId>
+    struct btree_index_key {
+        Key key;
+        RowId id;
+        signed char probe;
+        btree_index_key() : key(), id(), probe(0) {}
+        btree_index_key(const Key& key, const RowId& id, signed char probe = 0) : key(key), id(id), probe(probe) {}
+    };
+
+    template <class Key, class RowId>
+    struct btree_codec<btree_index_key<Key, RowId>> {
+        typedef btree_codec<Key> key_codec;
+        typedef btree_codec<RowId> id_codec;
+        typedef btree_index_key<Key, RowId> T;
+        static size_t common(const T& a, const T& b) { return key_codec::common(a.key, b.key); }
+        static size_t size(const T& x, size_t skip = 0) { return key_codec::size(x.key, skip) + id_codec::size(x.id); }
+        static char* write(char* p, const T& x, size_t skip = 0) {
+            return id_codec::write(key_codec::write(p, x.key, skip), x.id);
+        }
+        static const char* read(const char* p, T& x, const char* prefix = nullptr, size_t skip = 0) {
+            x.probe = 0;
+            return id_codec::read(key_codec::read(p, x.key, prefix, skip), x.id);
+        }
+        static const char* bytes(const T& x) { return key_codec::bytes(x.key); }
+        static T separator(const T&, const T& right) { return right; }
+    };
+
+    //key by Compare, then probe, then id by std::less.
+    template <class Key, class RowId, class Compare>
+    struct btree_index_less {
+        bool operator()(const btree_index_key<Key, RowId>& a, const btree_index_key<Key, RowId>& b) const {
+            Compare less;
+            if (less(a.key, b.key))
+                return true;
+            if (less(b.key, a.key))
+                return false;
+            if (a.probe != b.probe)
+                return a.probe < b.probe;
+            return std::less<RowId>()(a.id, b.id);
+        }
+    };
+
+    //Non-unique index from Key to the ids of the records having it, e.g. an attribute to row ids.
+    //Every (key, id) is one entry of a BTree ordered by key then id, with no value,
+    //so all ids of a key, or of a range of keys, come out of one range scan.
+    template <class Key, class RowId, class Compare = std::less<Key>, size_t PageSize = __BTREE_PAGE_SIZE__>
+    class BTreeIndex {
+    public:
+        typedef btree_index_key<Key, RowId> entry;
+        typedef BTree<entry, btree_none, btree_index_less<Key, RowId, Compare>, PageSize> tree_type;
+
+    private:
+        tree_type tree;
+
+    public:
+        BTreeIndex() : BTreeIndex("BTreeIndex.dat") {}
+        explicit BTreeIndex(const char* fname) : tree(fname) {}
+
+        void clear() { tree.clear(); }
+        void compact() { tree.compact(); }
+        //false if the pair is already there.
+        bool insert(const Key& key, const RowId& id) { return tree.insert(entry(key, id), btree_none()); }
+        bool erase(const Key& key, const RowId& id) { return tree.erase(entry(key, id)); }
+        bool contains(const Key& key, const RowId& id) { return tree.find(entry(key, id)) != tree.end(); }
+        //entries, not keys.
+        size_t size() const { return tree.size(); }
+        bool empty() const { return tree.empty(); }
+
+        //Ids of key, in increasing order.
+        std::vector<RowId> find(const Key& key) {
+            std::vector<RowId> ids;
+            auto sc = scan(key, key, true);
+            std::vector<pair<entry, btree_none>> batch;
+            while (sc.next(batch))
+                for (size_t i = 0; i < batch.size(); i++)
+                    ids.push_back(batch[i].first.id);
+            return ids;
+        }
+        size_t count(const Key& key) {
+            return find(key).size();
+        }
+        //(key, id) for keys in [lo, hi), or [lo, hi] with inclusive; a leaf at a time, see BTree::scan().
+        typename tree_type::scanner scan(const Key& lo, const Key& hi, bool inclusive = false) {
+            return tree.scan(entry(lo, RowId(), -1), entry(hi, RowId(), inclusive ? 1 : -1));
+        }
+    };
+
+    //* Write buffer
+    //BTree with a memtable in front. insert, modify and erase only change a std::map,
+    //which goes into the tree through apply_batch once it holds limit keys: in key order,
+    //every leaf read and written once, instead of a random page write per call.
+    //at() and contains() look in the memtable first.
+    //
+    //Writes still have to know whether the tree has the key, for what they return.
+    //The tree is opened with its filter for that, so new keys mostly cost no read.
+    //begin, find, lower_bound, scan and compact flush first and see the tree alone.
+    //Everything is done under one mutex, so unlike BTree, reads do not run together.
+    template <class Key, class Value, class Compare = std::less<Key>, size_t PageSize = __BTREE_PAGE_SIZE__>
+    class BufferedBTree {
+    public:
+        typedef BTree<Key, Value, Compare, PageSize> tree_type;
+        typedef typename tree_type::iterator iterator;
+        typedef typename tree_type::scanner scanner;
+
+    private:
+        typedef typename tree_type::batch_op batch_op;
+        //live: the key is there, with value. in_tree: the tree has it, as of the last flush.
+        struct slot {
+            Value value;
+            bool live;
+            bool in_tree;
+        };
+
+        tree_type tree;
+        std::map<Key, slot, Compare> memtable;
+        size_t limit;
+        //live keys the tree lacks, less the ones it has but are erased here.
+        long pending = 0;
+        std::mutex lock;
+
+        typedef typename std::map<Key, slot, Compare>::iterator entry;
+
+        //the memtable entry of key, made from the tree if there is none (fresh),
+        //so that a call changing nothing can take it out again.
+        entry __slot(const Key& key, bool& fresh) {
+            entry it = memtable.find(key);
+            fresh    = it == memtable.end();
+            if (!fresh)
+                return it;
+            iterator found = tree.find(key);
+            bool has       = found != tree.end();
+            return memtable.insert(std::make_pair(key, slot{has ? found.getValue() : Value(), has, has})).first;
+        }
+        bool __unchanged(entry it, bool fresh) {
+            if (fresh)
+                memtable.erase(it);
+            return false;
+        }
+        void __flush() {
+            if (memtable.empty())
+                return;
+            std::vector<batch_op> ops;
+            ops.reserve(memtable.size());
+            for (auto& kv : memtable) {
+                const slot& s = kv.second;
+                if (s.live)
+                    ops.push_back(batch_op{s.in_tree ? tree_type::batch_modify : tree_type::batch_insert, kv.first, s.value, false});
+                else if (s.in_tree)
+                    ops.push_back(batch_op{tree_type::batch_erase, kv.first, Value(), false});
+            }
+            //Cleared only once it is all in, so a failed flush can be tried again. The leaves
+            //before the failed one are in already: what the tree has decides insert or modify next time.
+            try {
+                tree.apply_batch(ops.data(), ops.size());
+            } catch (...) {
+                __resync();
+                throw;
+            }
+            memtable.clear();
+            pending = 0;
+        }
+        void __resync() {
+            pending = 0;
+            for (auto& kv : memtable) {
+                slot& s   = kv.second;
+                s.in_tree = tree.contains(kv.first);
+                pending += (long)(s.live && !s.in_tree) - (long)(!s.live && s.in_tree);
+            }
+        }
+        void __written() {
+            if (memtable.size() >= limit)
+                __flush();
+        }
+
+    public:
+        BufferedBTree() : BufferedBTree("BTree.dat") {}
+        explicit BufferedBTree(const char* fname, size_t limit = __BTREE_MEMTABLE__,
+                               typename tree_type::leaf_format format = tree_type::leaf_plain)
+            : tree(fname, format, true), limit(limit == 0 ? 1 : limit) {}
+
+        BufferedBTree(const BufferedBTree&) = delete;
+        BufferedBTree& operator=(const BufferedBTree&) = delete;
+
+        //Never throws, like ~BTree; writes that can't go into the tree are lost.
+        ~BufferedBTree() {
+            try {
+                __flush();
+            } catch (...) {
+            }
+        }
+
+        //Everything in the memtable goes into the tree.
+        void flush() {
+            std::lock_guard<std::mutex> guard(lock);
+            __flush();
+        }
+        void clear() {
+            std::lock_guard<std::mutex> guard(lock);
+            memtable.clear();
+            pending = 0;
+            tree.clear();
+        }
+        void compact() {
+            std::lock_guard<std::mutex> guard(lock);
+            __flush();
+            tree.compact();
+        }
+
+        //Checked here, not at the flush, so a too large entry is refused by the call that brings it.
+        bool insert(const Key& key, const Value& value) {
+            if (!tree_type::fits(key, value))
+                throw runtime_error();
+            std::lock_guard<std::mutex> guard(lock);
+            bool fresh;
+            entry it = __slot(key, fresh);
+            slot& s  = it->second;
+            if (s.live)
+                return __unchanged(it, fresh);
+            s.value = value;
+            s.live  = true;
+            pending++;
+            __written();
+            return true;
+        }
+        bool modify(const Key& key, const Value& value) {
+            if (!tree_type::fits(key, value))
+                throw runtime_error();
+            std::lock_guard<std::mutex> guard(lock);
+            bool fresh;
+            entry it = __slot(key, fresh);
+            slot& s  = it->second;
+            if (!s.live)
+                return __unchanged(it, fresh);
+            s.value = value;
+            __written();
+            return true;
+        }
+        bool erase(const Key& key) {
+            std::lock_guard<std::mutex> guard(lock);
+            bool fresh;
+            entry it = __slot(key, fresh);
+            slot& s  = it->second;
+            if (!s.live)
+                return __unchanged(it, fresh);
+            s.live  = false;
+            s.value = Value();
+            pending--;
+            __written();
+            return true;
+        }
+        Value at(const Key& key) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = memtable.find(key);
+            if (it != memtable.end())
+                return it->second.value;
+            return tree.at(key);
+        }
+        bool contains(const Key& key) {
+            std::lock_guard<std::mutex> guard(lock);
+            auto it = memtable.find(key);
+            if (it != memtable.end())
+                return it->second.live;
+            return tree.contains(key);
+        }
+        size_t size() {
+            std::lock_guard<std::mutex> guard(lock);
+            return tree.size() + pending;
+        }
+        bool empty() { return size() == 0; }
+
+        iterator begin() {
+            flush();
+            return tree.begin();
+        }
+        iterator end() { return tree.end(); }
+        iterator find(const Key& key) {
+            flush();
+            return tree.find(key);
+        }
+        iterator lower_bound(const Key& key) {
+            flush();
+            return tree.lower_bound(key);
+        }
+        scanner scan(const Key& lo, const Key& hi, int ahead = __BTREE_READAHEAD__) {
+            flush();
+            return tree.scan(lo, hi, ahead);
+        }
+    };
+}  // namespace sjtu
@@ -2,9 +2,15 @@
 #include <iostream>
 #include <string>
 #include "BTree.hpp"
+#include "oplog.hpp"
   //  test: constructor
 using namespace std;
+//-D__BTREE_BUFFERED__ puts a memtable in front of the tree (sjtu::BufferedBTree), writes go in sorted batches.
+#ifdef __BTREE_BUFFERED__
+sjtu::BufferedBTree<int, int> bTree;
+#else
 sjtu::BTree<int, int> bTree;
+#endif
 void insert(int key, int value){
   bTree.insert(key, value);
 }
@@ -33,7 +39,24 @@ void tester(){
     }else
     if(cmd == 'q'){
       cin >> key;
-      cout << query(key) << endl;
+      cout << query(key) << '\n';
+    }else{
+      puts("bad_command");
+    }
+  }
+}
+
+//stdin redirected from a binary op log is mapped and replayed in place.
+void replay(const oplog &log){
+  for(const op_record &r : log){
+    if(r.cmd == 'i'){
+      insert(r.key, r.value);
+    }else
+    if(r.cmd == 'e'){
+      erase(r.key);
+    }else
+    if(r.cmd == 'q'){
+      cout << query(r.key) << '\n';
     }else{
       puts("bad_command");
     }
@@ -41,6 +64,11 @@ void tester(){
 }
 
 int main(){
-  tester();
+  oplog log;
+  if(log.open(0)){
+    replay(log);
+  }else{
+    tester();
+  }
   return 0;
 }
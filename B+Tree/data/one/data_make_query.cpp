@@ -2,6 +2,7 @@
 #include <iostream>
 #include <fstream>  
 #include <string>
+#include "oplog.hpp"
 const long long maxn = 6 * 1e7;
 int flag[maxn] = {0};
 int key;
@@ -18,12 +19,15 @@ int rand(){
 }
 
 
-int main(){
-  ofstream OpenFile("query.data");
+int main(int argc, char *argv[]){
+  //binary op log (see oplog.hpp) unless run as `./queryData text`.
+  bool text = argc > 1 && string(argv[1]) == "text";
+  ofstream OpenFile("query.data", text ? ios::out : ios::out | ios::binary);
   if(OpenFile.fail()){  
     cout<<"Error while opening files."<<endl;
       exit(2);
     }  
+  oplog_put(OpenFile, text, 0, 0);
   for(long long i = 0; i < maxn; i++){
     key = (random_type) ? rand() % maxn : i;
     if(flag[key]) ;
@@ -33,7 +37,7 @@ int main(){
       int value = rand();
       //if(rand() % 2) OpenFile << 'q' << ' ' << key << '\n';
       //else OpenFile << 'e' << ' ' << key << '\n';
-      OpenFile << 'q' << ' ' << key  << '\n';
+      oplog_put(OpenFile, text, 'q', key);
     }
   }
   OpenFile.close();  
@@ -0,0 +1,99 @@
+#ifndef BPLUSTREE_OPLOG_H
+#define BPLUSTREE_OPLOG_H
+
+#include <cstring>
+#include <ostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//  Binary op log written by data_make*.cpp and replayed by BTree.cpp:
+//  the 4 bytes "BTOP", then one fixed-width record per op, in the byte order of the machine.
+//  The text format ("i key value", "q key", "e key", one per line) is still accepted everywhere.
+
+struct op_record {
+  char cmd;
+  char pad[3];
+  int key;
+  int value;
+};
+static_assert(sizeof(op_record) == 12, "op_record must be 12 bytes");
+
+const char oplog_magic[4] = {'B', 'T', 'O', 'P'};
+
+//out must be opened with ios::binary unless text. Call with cmd == 0 first to write the magic.
+inline void oplog_put(std::ostream &out, bool text, char cmd, int key, int value = 0) {
+  if (cmd == 0) {
+    if (!text) {
+      out.write(oplog_magic, sizeof(oplog_magic));
+    }
+    return;
+  }
+  if (text) {
+    out << cmd << ' ' << key;
+    if (cmd == 'i') {
+      out << ' ' << value;
+    }
+    out << '\n';
+    return;
+  }
+  op_record r = {cmd, {0, 0, 0}, key, value};
+  out.write((const char *)&r, sizeof(r));
+}
+
+//Maps a binary op log and hands out its records in place:
+//    oplog log;
+//    if (log.open(fd)) for (const op_record &r : log) ...
+//open() fails (and reads nothing) if fd is not a regular file holding a binary log,
+//e.g. a text file or a pipe, so the caller can fall back to reading text from it.
+class oplog {
+ private:
+  void *base;
+  size_t length;
+
+ public:
+  oplog() : base(nullptr), length(0) {}
+  oplog(const oplog &) = delete;
+  oplog &operator=(const oplog &) = delete;
+  ~oplog() {
+    if (base != nullptr) {
+      munmap(base, length);
+    }
+  }
+
+  bool open(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(oplog_magic)) {
+      return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    if (memcmp(p, oplog_magic, sizeof(oplog_magic)) != 0) {
+      munmap(p, st.st_size);
+      return false;
+    }
+#ifdef MADV_SEQUENTIAL
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+    base   = p;
+    length = st.st_size;
+    return true;
+  }
+
+  //the magic is 4 bytes, so records are 4-byte aligned like op_record.
+  const op_record *begin() const {
+    return (const op_record *)((const char *)base + sizeof(oplog_magic));
+  }
+  const op_record *end() const {
+    return begin() + size();
+  }
+  size_t size() const {
+    return base == nullptr ? 0 : (length - sizeof(oplog_magic)) / sizeof(op_record);
+  }
+};
+
+#endif
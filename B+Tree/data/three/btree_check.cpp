@@ -0,0 +1,767 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BTree.hpp"
+#include "oplog.hpp"
+//  Differential fuzzer and benchmark for sjtu::BTree<int, int>, all in one process.
+//  Workloads are generated in memory from a seed, run against the tree and a std::map (expect),
+//  and every result is compared. Only the tree calls are timed.
+//
+//  Phases, with the tree closed and reopened from its file between them:
+//    insert  ops random keys in [0, keys)
+//    query   ops lookups, about half of them present
+//    erase   ops / 10 erases (if erase = 1), then the same lookups again
+//    mixed   ops of insert / modify / erase / at / find / lower_bound / short walks,
+//            keys uniform, sequential or from a hot range
+//    scan    the whole tree by iterator
+//  then, with side = ops / 10:
+//    batch     side ops through apply_batch, side lookups through query_batch,
+//              and side / 100 bounded scans
+//    compact   about half of the keys erased, compact(), reopened, scanned
+//    filter    the same file reopened with its filter, mixed ops, reopened again
+//    packed    a new leaf_packed file, side inserts and mixed ops
+//    string    BTree<string, int> with 512 byte pages against a std::map,
+//              by std::less and then by a Compare ordering shorter keys first
+//    index     BTreeIndex<int, int> against a std::set of pairs
+//    buffered  BufferedBTree<int, int> with a small memtable against a std::map
+//    writer    an iterator walks the whole tree while another thread writes to it,
+//              and sees exactly what was there when it was made
+//
+//  usage: ./btree_check [ops = 1000000] [keys = 10 * ops] [seed = 1] [erase = 1] [check = 1]
+//  With check = 0 the std::map is left out, for timing the tree alone.
+//  Exits with 1 on the first mismatch, printing the phase, op number, key and seed.
+//
+//  ./btree_check log file [ops = 100000] [keys = 10 * ops] [seed = 1] [text = 0] writes an op log
+//  (see oplog.hpp) of random inserts, erases and queries for BTree.cpp, and
+//  ./btree_check replay file prints what BTree.cpp should answer to it, replayed on a std::map.
+//
+//  g++ -o btree_check btree_check.cpp -O2 -std=c++14 -pthread
+using namespace std;
+typedef chrono::steady_clock Clock;
+typedef sjtu::BTree<int, int> Tree;
+
+const char *file = "check.dat";
+const char *side_file = "check_side.dat";
+unique_ptr<Tree> tree;
+//how reopen() opens file.
+Tree::leaf_format format = Tree::leaf_plain;
+bool filtered = false;
+map<int, int> expect;
+bool check = true;
+unsigned seed;
+mt19937_64 rng;
+
+enum op_type { op_insert, op_modify, op_erase, op_at, op_find, op_lower_bound, op_walk,
+               op_batch, op_query_batch, op_scan, op_compact, op_count };
+const char *op_name[op_count] = {"insert", "modify", "erase", "at", "find", "lower_bound", "walk",
+                                 "batch", "query_batch", "scan", "compact"};
+
+//latencies in nanoseconds of one phase, by op type.
+vector<uint32_t> lat[op_count];
+const char *phase;
+long long op_no;
+
+void fail(int key, const char *what) {
+  printf("wrong at %s op %lld (%s, key %d, seed %u)\n", phase, op_no, what, key, seed);
+  exit(1);
+}
+void fail(const string &key, const char *what) {
+  printf("wrong at %s op %lld (%s, key \"%s\", seed %u)\n", phase, op_no, what, key.c_str(), seed);
+  exit(1);
+}
+
+void reopen() {
+  tree.reset();
+  tree.reset(new Tree(file, format, filtered));
+  if (check && tree->size() != expect.size()) {
+    fail(-1, "size after reopening");
+  }
+}
+
+void report(double wall) {
+  long long total = 0;
+  for (int t = 0; t < op_count; t++) {
+    vector<uint32_t> &v = lat[t];
+    if (v.empty()) {
+      continue;
+    }
+    total += v.size();
+    double busy = 0;
+    for (uint32_t ns : v) {
+      busy += ns;
+    }
+    sort(v.begin(), v.end());
+    auto at = [&v](double p) { return v[min(v.size() - 1, (size_t)(p * v.size()))]; };
+    printf("%s\t%s\t%zu\t%.0f\t%u\t%u\t%u\t%u\t%u\n", phase, op_name[t], v.size(), v.size() / busy * 1e9,
+           at(0.5), at(0.9), at(0.99), at(0.999), v.back());
+    v.clear();
+  }
+  printf("%s\tall\t%lld\t%.0f\n", phase, total, total / wall);
+  fflush(stdout);
+}
+
+template <class F>
+auto timed(op_type t, F f) -> decltype(f()) {
+  Clock::time_point start = Clock::now();
+  auto r = f();
+  lat[t].push_back((uint32_t)min<long long>(UINT32_MAX, chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count()));
+  return r;
+}
+
+void insert(int key, int value) {
+  bool got = timed(op_insert, [&] { return tree->insert(key, value); });
+  if (check && got != expect.insert(make_pair(key, value)).second) {
+    fail(key, "insert");
+  }
+}
+void modify(int key, int value) {
+  bool got = timed(op_modify, [&] { return tree->modify(key, value); });
+  if (!check) {
+    return;
+  }
+  auto it = expect.find(key);
+  if (got != (it != expect.end())) {
+    fail(key, "modify");
+  }
+  if (got) {
+    it->second = value;
+  }
+}
+void erase(int key) {
+  bool got = timed(op_erase, [&] { return tree->erase(key); });
+  if (check && got != (expect.erase(key) == 1)) {
+    fail(key, "erase");
+  }
+}
+void query(int key) {
+  int got = timed(op_at, [&] { return tree->at(key); });
+  if (!check) {
+    return;
+  }
+  auto it = expect.find(key);
+  if (got != (it == expect.end() ? 0 : it->second)) {
+    fail(key, "at");
+  }
+}
+void find(int key) {
+  Tree::iterator it = timed(op_find, [&] { return tree->find(key); });
+  if (!check) {
+    return;
+  }
+  auto r = expect.find(key);
+  if ((it == tree->end()) != (r == expect.end()) || (r != expect.end() && it.getValue() != r->second)) {
+    fail(key, "find");
+  }
+}
+//lower_bound, then a few steps forward.
+void walk(int key, int steps) {
+  Tree::iterator it = timed(op_lower_bound, [&] { return tree->lower_bound(key); });
+  auto r = expect.lower_bound(key);
+  for (int s = 0; s <= steps; s++) {
+    if (check) {
+      if ((it == tree->end()) != (r == expect.end())) {
+        fail(key, s ? "walk" : "lower_bound");
+      }
+      if (r == expect.end()) {
+        return;
+      }
+      if (it.getKey() != r->first || it.getValue() != r->second) {
+        fail(key, s ? "walk" : "lower_bound");
+      }
+      ++r;
+    } else if (it == tree->end()) {
+      return;
+    }
+    if (s < steps) {
+      timed(op_walk, [&] { return ++it, 0; });
+    }
+  }
+}
+
+//a key the tree probably has, or any key when it is empty.
+int present(int keys) {
+  if (!check || expect.empty()) {
+    return rng() % keys;
+  }
+  auto it = expect.lower_bound(rng() % keys);
+  return it == expect.end() ? expect.begin()->first : it->first;
+}
+
+void mixed(long long n, int keys, int reopens) {
+  int next = rng() % keys, hot = rng() % keys;
+  for (op_no = 0; op_no < n; op_no++) {
+    int key;
+    switch (rng() % 3) {
+    case 0:
+      key = rng() % keys;
+      break;
+    case 1:
+      key = next = (next + 1) % keys;
+      break;
+    default:
+      key = (hot + rng() % 1024) % keys;
+      break;
+    }
+    switch (rng() % 8) {
+    case 0:
+    case 1:
+      insert(key, (int)rng());
+      break;
+    case 2:
+      modify(rng() % 2 ? present(keys) : key, (int)rng());
+      break;
+    case 3:
+      erase(rng() % 2 ? present(keys) : key);
+      break;
+    case 4:
+    case 5:
+      query(key);
+      break;
+    case 6:
+      find(rng() % 2 ? present(keys) : key);
+      break;
+    default:
+      walk(key, rng() % 16);
+      break;
+    }
+    if (op_no % (n / reopens + 1) == n / reopens) {
+      reopen();
+    }
+  }
+}
+
+//t from it on against want from r on: steps + 1 pairs, or all of them with steps < 0.
+template <class T, class M>
+void same(T &t, typename T::iterator it, const M &want, typename M::const_iterator r, long long steps = -1) {
+  for (long long s = 0; steps < 0 || s <= steps; s++) {
+    if (check) {
+      if ((it == t.end()) != (r == want.end())) {
+        fail(r == want.end() ? it.getKey() : r->first, "walk");
+      }
+      if (r == want.end()) {
+        return;
+      }
+      if (it.getKey() != r->first || it.getValue() != r->second) {
+        fail(r->first, "walk");
+      }
+      ++r;
+    } else if (it == t.end()) {
+      return;
+    }
+    if (s != steps) {
+      timed(op_walk, [&] { return ++it, 0; });
+    }
+  }
+}
+
+//t.scan(lo, hi) against want.
+template <class T, class M>
+void same_range(T &t, const M &want, const typename M::key_type &lo, const typename M::key_type &hi) {
+  typename T::scanner sc = t.scan(lo, hi);
+  vector<sjtu::pair<typename M::key_type, int>> got;
+  auto r = want.lower_bound(lo);
+  while (timed(op_scan, [&] { return sc.next(got); })) {
+    for (size_t i = 0; check && i < got.size(); i++, ++r) {
+      if (r == want.end() || !want.key_comp()(r->first, hi) || got[i].first != r->first || got[i].second != r->second) {
+        fail(got[i].first, "scan");
+      }
+    }
+  }
+  if (check && r != want.end() && want.key_comp()(r->first, hi)) {
+    fail(r->first, "scan");
+  }
+}
+
+//n ops through apply_batch, in batches of up to 512, each result checked as if done alone.
+void apply_batches(long long n, int keys) {
+  vector<Tree::batch_op> ops;
+  for (op_no = 0; op_no < n; op_no += ops.size()) {
+    ops.resize(1 + rng() % 512);
+    for (auto &o : ops) {
+      o.type = (Tree::batch_op_type)(rng() % 4);
+      o.key = rng() % 2 ? present(keys) : rng() % keys;
+      o.value = (int)rng();
+    }
+    timed(op_batch, [&] { return tree->apply_batch(ops.data(), ops.size()), 0; });
+    for (size_t i = 0; check && i < ops.size(); i++) {
+      Tree::batch_op &o = ops[i];
+      auto it = expect.find(o.key);
+      bool has = it != expect.end();
+      switch (o.type) {
+      case Tree::batch_insert:
+        if (o.result == has) {
+          fail(o.key, "batch insert");
+        }
+        expect.insert(make_pair(o.key, o.value));
+        break;
+      case Tree::batch_modify:
+        if (o.result != has) {
+          fail(o.key, "batch modify");
+        }
+        if (has) {
+          it->second = o.value;
+        }
+        break;
+      case Tree::batch_erase:
+        if (o.result != has) {
+          fail(o.key, "batch erase");
+        }
+        if (has) {
+          expect.erase(it);
+        }
+        break;
+      default:
+        if (o.result != has || (has && o.value != it->second)) {
+          fail(o.key, "batch query");
+        }
+        break;
+      }
+    }
+  }
+}
+
+void query_batches(long long n, int keys) {
+  vector<Tree::batch_op> ops(1024);
+  for (op_no = 0; op_no < n; op_no += ops.size()) {
+    for (auto &o : ops) {
+      o.key = rng() % 2 ? present(keys) : rng() % keys;
+    }
+    timed(op_query_batch, [&] { return tree->query_batch(ops.data(), ops.size()), 0; });
+    for (size_t i = 0; check && i < ops.size(); i++) {
+      auto it = expect.find(ops[i].key);
+      if (ops[i].result != (it != expect.end()) || (ops[i].result && ops[i].value != it->second)) {
+        fail(ops[i].key, "query_batch");
+      }
+    }
+  }
+}
+
+//n ops of insert / modify / erase / at, and lower_bound with short walks if walks,
+//on a tree of another kind against want. open() makes it again from its file, every n / 4 ops.
+template <class T, class M, class K, class O>
+void side_mixed(unique_ptr<T> &t, M &want, long long n, bool walks, K key, O open) {
+  for (op_no = 0; op_no < n; op_no++) {
+    typename M::key_type k = key();
+    int value = (int)rng();
+    auto r = want.find(k);
+    bool has = r != want.end(), got;
+    switch (rng() % 6) {
+    case 0:
+    case 1:
+      got = timed(op_insert, [&] { return t->insert(k, value); });
+      if (check && got != !has) {
+        fail(k, "insert");
+      }
+      want.insert(make_pair(k, value));
+      break;
+    case 2:
+      got = timed(op_modify, [&] { return t->modify(k, value); });
+      if (check && got != has) {
+        fail(k, "modify");
+      }
+      if (has) {
+        r->second = value;
+      }
+      break;
+    case 3:
+      got = timed(op_erase, [&] { return t->erase(k); });
+      if (check && got != has) {
+        fail(k, "erase");
+      }
+      want.erase(k);
+      break;
+    case 4:
+      if (timed(op_at, [&] { return t->at(k); }) != (has ? r->second : 0) && check) {
+        fail(k, "at");
+      }
+      break;
+    default:
+      if (walks) {
+        typename T::iterator it = timed(op_lower_bound, [&] { return t->lower_bound(k); });
+        same(*t, it, want, want.lower_bound(k), rng() % 16);
+      } else if (timed(op_find, [&] { return t->contains(k); }) != has && check) {
+        fail(k, "contains");
+      }
+      break;
+    }
+    if (op_no % (n / 4 + 1) == n / 4) {
+      t.reset();
+      t.reset(open());
+      if (check && t->size() != want.size()) {
+        fail(k, "size after reopening");
+      }
+    }
+  }
+}
+
+//keys of the string tree, sharing prefixes of many lengths.
+string str_key(int keys) {
+  static const char *prefix[] = {"", "k", "user/", "user/profile/", "log/2024-01-01/host-"};
+  int x = rng() % keys;
+  return prefix[x % 5] + to_string(x) + string(x % 13, '.');
+}
+
+//shorter keys first, then by bytes. Keys of a leaf need not share what its first and last share.
+struct by_length {
+  bool operator()(const string &a, const string &b) const {
+    return a.size() != b.size() ? a.size() < b.size() : a < b;
+  }
+};
+
+int write_log(const char *name, long long ops, int keys, bool text) {
+  ofstream out(name, text ? ios::out : ios::out | ios::binary);
+  if (out.fail()) {
+    printf("can't write %s\n", name);
+    return 1;
+  }
+  oplog_put(out, text, 0, 0);
+  for (long long i = 0; i < ops; i++) {
+    int key = rng() % keys;
+    switch (rng() % 10) {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+      oplog_put(out, text, 'i', key, (int)rng());
+      break;
+    case 5:
+    case 6:
+      oplog_put(out, text, 'e', key);
+      break;
+    default:
+      oplog_put(out, text, 'q', key);
+      break;
+    }
+  }
+  return 0;
+}
+
+//BTree.cpp on a std::map: insert keeps an existing value, a missing key reads as 0.
+void replay_op(char cmd, int key, int value) {
+  if (cmd == 'i') {
+    expect.insert(make_pair(key, value));
+  } else if (cmd == 'e') {
+    expect.erase(key);
+  } else if (cmd == 'q') {
+    auto it = expect.find(key);
+    printf("%d\n", it == expect.end() ? 0 : it->second);
+  } else {
+    puts("bad_command");
+  }
+}
+
+int replay_log(const char *name) {
+  FILE *f = fopen(name, "rb");
+  if (f == nullptr) {
+    printf("can't read %s\n", name);
+    return 1;
+  }
+  oplog log;
+  if (log.open(fileno(f))) {
+    for (const op_record &r : log) {
+      replay_op(r.cmd, r.key, r.value);
+    }
+  } else {
+    ifstream in(name);
+    char cmd;
+    int key, value = 0;
+    while (in >> cmd >> key) {
+      if (cmd == 'i') {
+        in >> value;
+      }
+      replay_op(cmd, key, value);
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 2 && string(argv[1]) == "log") {
+    long long ops = argc > 3 ? atoll(argv[3]) : 100000;
+    int keys = argc > 4 ? atoi(argv[4]) : (int)min(10 * ops, (long long)INT32_MAX);
+    rng.seed(argc > 5 ? atoi(argv[5]) : 1);
+    return write_log(argv[2], ops, keys, argc > 6 && atoi(argv[6]));
+  }
+  if (argc > 2 && string(argv[1]) == "replay") {
+    return replay_log(argv[2]);
+  }
+  long long ops = argc > 1 ? atoll(argv[1]) : 1000000;
+  int keys = argc > 2 ? atoi(argv[2]) : (int)min(10 * ops, (long long)INT32_MAX);
+  seed = argc > 3 ? atoi(argv[3]) : 1;
+  bool with_erase = argc > 4 ? atoi(argv[4]) : true;
+  check = argc > 5 ? atoi(argv[5]) : true;
+  long long side = max(ops / 10, 1LL);
+  rng.seed(seed);
+  remove(file);
+  tree.reset(new Tree(file));
+  printf("phase\top\tcount\tops/s\tp50(ns)\tp90\tp99\tp99.9\tmax\n");
+
+  phase = "insert";
+  Clock::time_point start = Clock::now();
+  for (op_no = 0; op_no < ops; op_no++) {
+    insert(rng() % keys, (int)rng());
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+  reopen();
+
+  vector<int> probe(ops);
+  for (auto &key : probe) {
+    key = rng() % 2 ? present(keys) : rng() % keys;
+  }
+  phase = "query";
+  start = Clock::now();
+  for (op_no = 0; op_no < ops; op_no++) {
+    query(probe[op_no]);
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  if (with_erase) {
+    phase = "erase";
+    start = Clock::now();
+    for (op_no = 0; op_no < ops / 10; op_no++) {
+      erase(rng() % 2 ? present(keys) : rng() % keys);
+    }
+    reopen();
+    for (op_no = 0; op_no < ops; op_no++) {
+      query(probe[op_no]);
+    }
+    report(chrono::duration<double>(Clock::now() - start).count());
+  }
+
+  phase = "mixed";
+  start = Clock::now();
+  mixed(ops, keys, 4);
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  phase = "scan";
+  reopen();
+  start = Clock::now();
+  same(*tree, tree->begin(), expect, expect.begin());
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  phase = "batch";
+  start = Clock::now();
+  apply_batches(side, keys);
+  reopen();
+  query_batches(side, keys);
+  for (op_no = 0; op_no < side / 100 + 1; op_no++) {
+    int lo = rng() % keys;
+    same_range(*tree, expect, lo, lo + (int)(rng() % (keys / 100 + 1)));
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  phase = "compact";
+  vector<int> victims;
+  for (Tree::iterator it = tree->begin(); it != tree->end(); ++it) {
+    if (rng() % 2) {
+      victims.push_back(it.getKey());
+    }
+  }
+  start = Clock::now();
+  for (op_no = 0; op_no < (long long)victims.size(); op_no++) {
+    erase(victims[op_no]);
+  }
+  timed(op_compact, [&] { return tree->compact(), 0; });
+  reopen();
+  same(*tree, tree->begin(), expect, expect.begin());
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  //the filter is made from the file at this open, and kept in it by the next ones.
+  phase = "filter";
+  filtered = true;
+  start = Clock::now();
+  reopen();
+  for (op_no = 0; op_no < side; op_no++) {
+    query(rng() % 2 ? present(keys) : rng() % keys);
+  }
+  mixed(side, keys, 2);
+  filtered = false;
+  reopen();
+  for (op_no = 0; op_no < side; op_no++) {
+    query(rng() % 2 ? present(keys) : rng() % keys);
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  phase = "packed";
+  tree.reset();
+  remove(file);
+  expect.clear();
+  format = Tree::leaf_packed;
+  tree.reset(new Tree(file, format, filtered));
+  start = Clock::now();
+  for (op_no = 0; op_no < side; op_no++) {
+    insert(rng() % keys, (int)rng());
+  }
+  reopen();
+  mixed(side, keys, 2);
+  reopen();
+  same(*tree, tree->begin(), expect, expect.begin());
+  report(chrono::duration<double>(Clock::now() - start).count());
+
+  //The iterator is made before the writer starts, so it must see before exactly.
+  //Only this thread times ops; the writer checks its own against expect.
+  phase = "writer";
+  start = Clock::now();
+  {
+    map<int, int> before = expect;
+    Tree::iterator it = tree->begin();
+    mt19937_64 own(rng());
+    thread writer([&] {
+      for (long long i = 0; i < side; i++) {
+        int key = own() % keys, value = (int)own();
+        if (own() % 2) {
+          if (tree->insert(key, value) != expect.insert(make_pair(key, value)).second && check) {
+            fail(key, "insert by the writer");
+          }
+        } else if (tree->erase(key) != (expect.erase(key) == 1) && check) {
+          fail(key, "erase by the writer");
+        }
+      }
+    });
+    same(*tree, it, before, before.begin());
+    writer.join();
+  }
+  reopen();
+  same(*tree, tree->begin(), expect, expect.begin());
+  report(chrono::duration<double>(Clock::now() - start).count());
+  tree.reset();
+  remove(file);
+
+  int range = (int)min(side, (long long)INT32_MAX);
+  phase = "string";
+  remove(side_file);
+  start = Clock::now();
+  {
+    typedef sjtu::BTree<string, int, less<string>, 512> StrTree;
+    auto open = [] { return new StrTree(side_file); };
+    unique_ptr<StrTree> t(open());
+    map<string, int> want;
+    side_mixed(t, want, 2 * side, true, [range] { return str_key(range); }, open);
+    same(*t, t->begin(), want, want.begin());
+    for (op_no = 0; op_no < side / 100 + 1; op_no++) {
+      string lo = str_key(range), hi = str_key(range);
+      same_range(*t, want, min(lo, hi), max(lo, hi));
+    }
+  }
+  remove(side_file);
+  {
+    typedef sjtu::BTree<string, int, by_length, 512> LenTree;
+    auto open = [] { return new LenTree(side_file); };
+    unique_ptr<LenTree> t(open());
+    map<string, int, by_length> want;
+    side_mixed(t, want, 2 * side, true, [range] { return str_key(range); }, open);
+    same(*t, t->begin(), want, want.begin());
+    for (op_no = 0; op_no < side / 100 + 1; op_no++) {
+      string lo = str_key(range), hi = str_key(range);
+      same_range(*t, want, min(lo, hi, by_length()), max(lo, hi, by_length()));
+    }
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+  remove(side_file);
+
+  //about 8 ids per key.
+  phase = "index";
+  start = Clock::now();
+  {
+    typedef sjtu::BTreeIndex<int, int> Index;
+    unique_ptr<Index> idx(new Index(side_file));
+    set<pair<int, int>> want;
+    int index_keys = range / 8 + 1;
+    for (op_no = 0; op_no < 2 * side; op_no++) {
+      int key = rng() % index_keys, id = rng() % 64;
+      bool got;
+      switch (rng() % 5) {
+      case 0:
+      case 1:
+        got = timed(op_insert, [&] { return idx->insert(key, id); });
+        if (got != want.insert(make_pair(key, id)).second && check) {
+          fail(key, "index insert");
+        }
+        break;
+      case 2:
+        got = timed(op_erase, [&] { return idx->erase(key, id); });
+        if (got != (want.erase(make_pair(key, id)) == 1) && check) {
+          fail(key, "index erase");
+        }
+        break;
+      case 3:
+        got = timed(op_at, [&] { return idx->contains(key, id); });
+        if (got != want.count(make_pair(key, id)) && check) {
+          fail(key, "index contains");
+        }
+        break;
+      default: {
+        vector<int> ids = timed(op_find, [&] { return idx->find(key); });
+        vector<int> ids_want;
+        for (auto r = want.lower_bound(make_pair(key, INT32_MIN)); r != want.end() && r->first == key; ++r) {
+          ids_want.push_back(r->second);
+        }
+        if (ids != ids_want && check) {
+          fail(key, "index find");
+        }
+        break;
+      }
+      }
+      if (op_no % (side / 2 + 1) == side / 2) {
+        idx.reset();
+        idx.reset(new Index(side_file));
+        if (check && idx->size() != want.size()) {
+          fail(key, "index size after reopening");
+        }
+      }
+    }
+    for (op_no = 0; op_no < side / 100 + 1; op_no++) {
+      int lo = rng() % index_keys, hi = lo + rng() % 16;
+      bool inclusive = rng() % 2;
+      Index::tree_type::scanner sc = idx->scan(lo, hi, inclusive);
+      vector<sjtu::pair<Index::entry, sjtu::btree_none>> got;
+      auto r = want.lower_bound(make_pair(lo, INT32_MIN));
+      while (timed(op_scan, [&] { return sc.next(got); })) {
+        for (size_t i = 0; check && i < got.size(); i++, ++r) {
+          if (r == want.end() || r->first > hi || (r->first == hi && !inclusive) || got[i].first.key != r->first
+              || got[i].first.id != r->second) {
+            fail(got[i].first.key, "index scan");
+          }
+        }
+      }
+      if (check && r != want.end() && (r->first < hi || (r->first == hi && inclusive))) {
+        fail(r->first, "index scan");
+      }
+    }
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+  remove(side_file);
+
+  //a small memtable, so it is written to the tree often between reopens.
+  phase = "buffered";
+  start = Clock::now();
+  {
+    typedef sjtu::BufferedBTree<int, int> Buffered;
+    auto open = [] { return new Buffered(side_file, 1000); };
+    unique_ptr<Buffered> t(open());
+    map<int, int> want;
+    side_mixed(t, want, 2 * side, false, [range] { return (int)(rng() % range); }, open);
+    same(*t, t->begin(), want, want.begin());
+    for (op_no = 0; op_no < side / 100 + 1; op_no++) {
+      int lo = rng() % range;
+      same_range(*t, want, lo, lo + (int)(rng() % 1024));
+    }
+  }
+  report(chrono::duration<double>(Clock::now() - start).count());
+  remove(side_file);
+
+  puts(check ? "PASS" : "DONE");
+  return 0;
+}
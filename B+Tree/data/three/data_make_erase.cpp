@@ -3,6 +3,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include "oplog.hpp"
 const long long maxn = 6 * 1e6;
 int flag[maxn] = {0};
 int key;
@@ -19,12 +20,15 @@ int rand(){
 }
 
 
-int main(){
-    ofstream OpenFile("erase.data");
+int main(int argc, char *argv[]){
+    //binary op log (see oplog.hpp) unless run as `./eraseData text`.
+    bool text = argc > 1 && string(argv[1]) == "text";
+    ofstream OpenFile("erase.data", text ? ios::out : ios::out | ios::binary);
     if(OpenFile.fail()){
         cout<<"Error while opening files."<<endl;
         exit(2);
     }
+    oplog_put(OpenFile, text, 0, 0);
     for(long long i = 0; i < maxn; i++){
         key = (random_type) ? rand() % maxn : i;
         if(flag[key]) ;
@@ -34,7 +38,7 @@ int main(){
             int value = rand();
             //if(rand() % 2) OpenFile << 'q' << ' ' << key << '\n';
             //else OpenFile << 'e' << ' ' << key << '\n';
-            OpenFile << 'e' << ' ' << key  << '\n';
+            oplog_put(OpenFile, text, 'e', key);
         }
     }
     OpenFile.close();
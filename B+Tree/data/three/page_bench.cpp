@@ -0,0 +1,135 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BTree.hpp"
+//  Page size matrix for sjtu::BTree<int, int>: the same workload on 4K, 8K, 16K and 64K pages.
+//    insert  keys distinct keys, in a scattered order
+//    cold    queries lookups, half of them present, after the file is dropped from the page cache
+//    warm    the same lookups again
+//    scan    the whole tree by scan()
+//  One line per page size: ops/s of each phase, the file size and bytes per key.
+//
+//  usage: ./page_bench [keys = 60000000] [queries = 1000000] [fanout = 0] [seed = 1]
+//  fanout caps the entries per node (BTree's Fanout), 0 leaves it to the page size.
+//  Only 0, 64, 256 and 1024 are compiled in.
+//
+//  g++ -o page_bench page_bench.cpp -O2 -std=c++14 -pthread
+using namespace std;
+typedef chrono::steady_clock Clock;
+
+const char *file = "page.dat";
+
+//i -> key is a bijection on [0, 2^31), so keys never repeat.
+int key_of(long long i) {
+  return (int)((unsigned)(i * 2654435761u) & 0x7fffffffu);
+}
+
+double since(Clock::time_point start) {
+  return chrono::duration<double>(Clock::now() - start).count();
+}
+
+long file_size() {
+  struct stat st;
+  return stat(file, &st) == 0 ? st.st_size : 0;
+}
+
+//so that the next open reads the disk, as far as the kernel lets us.
+void drop_cache() {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+template <size_t PageSize, size_t Fanout>
+void run(long long keys, long long queries, unsigned seed) {
+  typedef sjtu::BTree<int, int, less<int>, PageSize, Fanout> Tree;
+  mt19937_64 rng(seed);
+  remove(file);
+  double insert, cold, warm, scan;
+  long long found = 0, scanned = 0;
+  {
+    Tree tree(file);
+    Clock::time_point start = Clock::now();
+    for (long long i = 0; i < keys; i++) {
+      tree.insert(key_of(i), (int)i);
+    }
+    insert = keys / since(start);
+  }
+  long bytes = file_size();
+
+  vector<int> probe(queries);
+  for (auto &key : probe) {
+    key = rng() % 2 ? key_of(rng() % keys) : (int)(rng() & 0x7fffffff);
+  }
+  drop_cache();
+  {
+    Tree tree(file);
+    Clock::time_point start = Clock::now();
+    for (int key : probe) {
+      found += tree.at(key) != 0;
+    }
+    cold  = queries / since(start);
+    start = Clock::now();
+    for (int key : probe) {
+      found += tree.at(key) != 0;
+    }
+    warm  = queries / since(start);
+    start = Clock::now();
+    auto sc = tree.scan(0, 0x7fffffff);
+    vector<sjtu::pair<int, int>> batch;
+    while (sc.next(batch)) {
+      scanned += batch.size();
+    }
+    scan = scanned / since(start);
+  }
+  if (scanned != keys) {
+    printf("scan found %lld of %lld keys\n", scanned, keys);
+    exit(1);
+  }
+  printf("%zuK\t%.0f\t%.0f\t%.0f\t%.0f\t%.1f\t%.2f\t%lld\n", PageSize / 1024, insert, cold, warm, scan,
+         bytes / 1048576.0, (double)bytes / keys, found);
+  fflush(stdout);
+  remove(file);
+}
+
+template <size_t Fanout>
+void matrix(long long keys, long long queries, unsigned seed) {
+  run<4096, Fanout>(keys, queries, seed);
+  run<8192, Fanout>(keys, queries, seed);
+  run<16384, Fanout>(keys, queries, seed);
+  run<65536, Fanout>(keys, queries, seed);
+}
+
+int main(int argc, char *argv[]) {
+  long long keys    = argc > 1 ? atoll(argv[1]) : 60000000;
+  long long queries = argc > 2 ? atoll(argv[2]) : 1000000;
+  int fanout        = argc > 3 ? atoi(argv[3]) : 0;
+  unsigned seed     = argc > 4 ? atoi(argv[4]) : 1;
+  printf("page\tinsert/s\tcold/s\twarm/s\tscan/s\tfile(MB)\tbytes/key\tfound\n");
+  switch (fanout) {
+  case 0:
+    matrix<0>(keys, queries, seed);
+    break;
+  case 64:
+    matrix<64>(keys, queries, seed);
+    break;
+  case 256:
+    matrix<256>(keys, queries, seed);
+    break;
+  case 1024:
+    matrix<1024>(keys, queries, seed);
+    break;
+  default:
+    printf("fanout must be 0, 64, 256 or 1024\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BTree.hpp"
+#include "oplog.hpp"
+//  Replays query.data (from data_make_query.cpp) against the tree built by
+//  `./BTree < insert.data`, split across 1, 2, 4 ... N reader threads.
+//  Every run is checked against the single-threaded answers.
+//
+//  usage: ./query_threads [N = 8] [writer = 0]
+//  With writer = 1 another thread keeps inserting and erasing negative keys
+//  (never queried) for the whole run, so readers share the tree with a writer.
+//  They are all erased again before exit. Readers must not hold the writer off:
+//  each run also prints the writes per second, and fails if the writer got none
+//  done, or if a single write took over a second.
+//
+//  g++ -o query_threads query_threads.cpp -O2 -std=c++14 -pthread
+using namespace std;
+typedef chrono::steady_clock Clock;
+sjtu::BTree<int, int> bTree;
+vector<int> keys;
+//writes done by the writer thread, and the longest one in nanoseconds.
+atomic<long long> writes(0), slowest(0);
+
+void reader(size_t l, size_t r, int *out) {
+  for (size_t i = l; i < r; i++) {
+    out[i] = bTree.at(keys[i]);
+  }
+}
+
+double run(int threads, vector<int> &out) {
+  vector<thread> pool;
+  Clock::time_point start = Clock::now();
+  size_t chunk = (keys.size() + threads - 1) / threads;
+  for (int t = 0; t < threads; t++) {
+    size_t l = min(keys.size(), chunk * t), r = min(keys.size(), chunk * (t + 1));
+    pool.push_back(thread(reader, l, r, out.data()));
+  }
+  for (auto &th : pool) {
+    th.join();
+  }
+  return chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  bool with_writer = argc > 2 && atoi(argv[2]);
+  //query.data in either format.
+  int fd = open("query.data", O_RDONLY);
+  if (fd < 0) {
+    cout << "Run data_make_query first." << endl;
+    return 2;
+  }
+  oplog log;
+  if (log.open(fd)) {
+    for (const op_record &r : log) {
+      if (r.cmd == 'q') {
+        keys.push_back(r.key);
+      }
+    }
+  } else {
+    ifstream File("query.data");
+    char cmd;
+    int key;
+    while (File >> cmd >> key) {
+      if (cmd == 'q') {
+        keys.push_back(key);
+      }
+    }
+  }
+  close(fd);
+
+  vector<int> expect(keys.size()), got(keys.size());
+  double base = run(1, expect);
+
+  //keeps a window of the last 1000 keys inserted, so leaves split and merge.
+  atomic<bool> stop(false);
+  thread writer;
+  if (with_writer) {
+    writer = thread([&stop]() {
+      int i = 1;
+      for (; !stop; i++) {
+        Clock::time_point start = Clock::now();
+        bTree.insert(-i, i);
+        if (i > 1000) {
+          bTree.erase(-(i - 1000));
+        }
+        long long ns = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+        slowest = max((long long)slowest, ns);
+        writes++;
+      }
+      for (int j = max(1, i - 1000); j < i; j++) {
+        bTree.erase(-j);
+      }
+    });
+  }
+
+  cout << "threads\tseconds\tqueries/s\tspeedup" << (with_writer ? "\twrites/s" : "") << endl;
+  cout << 1 << '\t' << base << '\t' << keys.size() / base << '\t' << 1.0 << endl;
+  for (int threads = 2; threads <= max_threads; threads <<= 1) {
+    long long before = writes;
+    double t = run(threads, got);
+    long long done = writes - before;
+    const char *wrong = nullptr;
+    if (got != expect) {
+      wrong = "wrong answer";
+    } else if (with_writer && (done == 0 || slowest > 1000000000)) {
+      wrong = "writer starved";
+    }
+    if (wrong != nullptr) {
+      cout << wrong << " with " << threads << " threads" << endl;
+      stop = true;
+      if (with_writer) {
+        writer.join();
+      }
+      return 1;
+    }
+    cout << threads << '\t' << t << '\t' << keys.size() / t << '\t' << base / t;
+    if (with_writer) {
+      cout << '\t' << done / t;
+    }
+    cout << endl;
+  }
+  stop = true;
+  if (with_writer) {
+    writer.join();
+  }
+  return 0;
+}
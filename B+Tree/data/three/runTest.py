@@ -5,22 +5,32 @@ if returnID != 0:
     print('Fail to clear Data')
     exit(-1)
 
-returnID = os.system('g++ -o insertionData data_make.cpp -O2 -std=c++14 -w')
+returnID = os.system('g++ -o BTree BTree.cpp -O2 -std=c++14 -g')
 if returnID != 0:
-    print('Fail to make Insertion Data Generator!')
+    print('Fail to make your BTree, please check whether there exists any compilication error!')
     exit(-1)
 
-returnID = os.system('g++ -o queryData data_make_query.cpp -O2 -std=c++14 -w')
+# runs the tree and std::map side by side in one process, see btree_check.cpp
+# arguments: ops, key range, seed, erase
+returnID = os.system('g++ -o btree_check btree_check.cpp -O2 -std=c++14 -pthread')
 if returnID != 0:
-    print('Fail to make Query Data Generator!')
+    print('Fail to make the checker, please check whether there exists any compilication error!')
     exit(-1)
+print('[Accepted] Compiling')
 
-os.system('./insertionData > tmp && ./queryData > tmp && ./eraseData > tmp && rm tmp')
-returnID = os.system('g++ -o BTree BTree.cpp -O2 -std=c++14 -g')
+# a small op log (see oplog.hpp) replayed by BTree.cpp, binary (mapped) and then text,
+# must get the same answers as a std::map replaying it
+for text in ['0', '1']:
+    if os.path.exists('BTree.dat'):
+        os.remove('BTree.dat')
+    returnID = os.system('./btree_check log ops.data 200000 200000 99962 ' + text + ' && ./BTree < ops.data > tree.out'
+                         ' && ./btree_check replay ops.data > map.out')
+    if returnID != 0 or open('tree.out').read() != open('map.out').read():
+        print('Wrong answer replaying the ' + ('text' if text == '1' else 'binary') + ' op log')
+        exit(-1)
+os.system('rm -f ops.data tree.out map.out BTree.dat')
+print('[Accepted] Op log')
+
+returnID = os.system('./btree_check 5000000 60000000 99962 1')
 if returnID != 0:
-    print('Fail to make your BTree, please check whether there exists any compilication error!')
     exit(-1)
-
-os.system('g++ -o target sql_checker.cpp -O2 -std=c++14 -w -l sqlite3')
-print('[Accepted] Compiling')
-os.system('./target')
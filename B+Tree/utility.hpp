@@ -15,6 +15,8 @@ namespace sjtu{
         constexpr pair() : first(), second() {}
         pair(const pair &other) = default;
         pair(pair &&other) = default;
+        pair &operator=(const pair &other) = default;
+        pair &operator=(pair &&other) = default;
         pair(const T1 &x, const T2 &y) : first(x), second(y) {}
         template<class U1, class U2>
         pair(U1 &&x, U2 &&y) : first(x), second(y) {}
@@ -24,7 +26,16 @@ namespace sjtu{
         pair(pair<U1, U2> &&other) : first(other.first), second(other.second) {}
     };
 
-}
+    //lexicographic, so pairs can be composite keys.
+    template<class T1, class T2>
+    bool operator==(const pair<T1, T2> &a, const pair<T1, T2> &b) {
+        return a.first == b.first && a.second == b.second;
+    }
+    template<class T1, class T2>
+    bool operator<(const pair<T1, T2> &a, const pair<T1, T2> &b) {
+        return a.first < b.first || (!(b.first < a.first) && a.second < b.second);
+    }
+
 }
 
 #endif //BPLUSTREE_UTILITY_H
@@ -0,0 +1,425 @@
+#include "../vector/vector.hpp"
+#include "../deque/deque.hpp"
+#include "../mapB/map.hpp"
+
+#include "../vector/data/class-bint.hpp"
+#include "../vector/data/class-integer.hpp"
+#include "../vector/data/class-matrix.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//  One benchmark for sjtu::vector, sjtu::deque and sjtu::map (mapB) against std::vector, std::deque and std::map.
+//  Every op is run on both, std first, with the same elements in the same order,
+//  and a digest of what was read is compared so that the two are known to have done the same work.
+//
+//  containers  vector  push_back, index (random), iterate, copy, insert (middle), pop_back
+//              deque   push_back, push_front, index (random), iterate, insert (random), pop_front
+//              map     insert (random keys), find, iterate, erase
+//  elements    int, Integer (class-integer.hpp), Util::Bint (class-bint.hpp), Diamond::Matrix<double> 2x2
+//              (class-matrix.hpp); map keys are int, these are the values.
+//  sizes       1e3, 1e4 ... up to --max, each skipped where it would take more than --budget MiB.
+//              insert into the middle / at random positions does min(n, 1000) of them on n elements.
+//
+//  Each op is timed by the wall clock and, on x86, the time stamp counter (cycles at the nominal rate).
+//  The best of 5 runs is kept below 1e5 elements, of 3 below 1e7, otherwise one.
+//
+//  usage: ./bench [--max N = 1000000] [--budget MiB = 2048] [--only vector|deque|map]
+//                 [--type int|Integer|Bint|Matrix] [--json FILE = bench.json]
+//  Prints a table and writes every result to FILE, see readme.md for its layout.
+//  Exits with 1 if any digest differs.
+//
+//  g++ -o bench bench.cpp -O2 -std=c++14
+using namespace std;
+using Util::Bint;
+using Diamond::Matrix;
+typedef chrono::steady_clock Clock;
+
+struct timing {
+    double ns;
+    uint64_t cycles;
+};
+
+uint64_t cycles_now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+//* Elements
+template <class T>
+T make(uint64_t i);
+template <>
+int make<int>(uint64_t i) { return (int)i; }
+template <>
+Integer make<Integer>(uint64_t i) { return Integer((int)i); }
+template <>
+Bint make<Bint>(uint64_t i) { return Bint((long long)i); }
+template <>
+Matrix<double> make<Matrix<double>>(uint64_t i) { return Matrix<double>(2, 2, (double)i); }
+
+//the compiler has to assume x is read, so loops over elements that show nothing are not dropped.
+template <class T>
+void keep(const T& x) {
+    asm volatile("" : : "r"(&x) : "memory");
+}
+
+//what reading an element adds to the digest. Integer and Bint show nothing cheaply, they count.
+uint64_t digest(int x) { return (uint64_t)x * 0x9e3779b97f4a7c15ULL; }
+uint64_t digest(const Integer& x) {
+    keep(x);
+    return 1;
+}
+uint64_t digest(const Bint& x) {
+    keep(x);
+    return 1;
+}
+uint64_t digest(const Matrix<double>& m) { return (uint64_t)m[0][0] * 0x9e3779b97f4a7c15ULL + m.RowSize(); }
+
+//Rough bytes one element takes, with its heap, to keep within --budget.
+//make<Bint> values fit in 64 bits, so a Bint keeps them inline.
+template <class T>
+size_t footprint() { return sizeof(T); }
+template <>
+size_t footprint<Matrix<double>>() { return sizeof(Matrix<double>) + 4 * sizeof(double) + 32; }
+
+const char* type_name(int) { return "int"; }
+const char* type_name(Integer) { return "Integer"; }
+const char* type_name(Bint) { return "Bint"; }
+const char* type_name(Matrix<double>) { return "Matrix"; }
+
+//i -> key is a bijection on 32 bits, so keys never repeat.
+int key_of(uint64_t i) { return (int)(uint32_t)(i * 2654435761u); }
+
+//xorshift, the same stream for std and sjtu.
+struct rng {
+    uint64_t s;
+    explicit rng(uint64_t seed) : s(seed * 0x9e3779b97f4a7c15ULL + 1) {}
+    uint64_t operator()() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+//* Results
+struct result {
+    string container, type, op;
+    size_t n, ops;
+    timing ours, theirs;
+    bool match;
+};
+vector<result> results;
+bool all_match = true;
+
+//setup() makes a fresh container, only body(container) is timed and returns the digest.
+template <class C, class Setup, class Body>
+timing measure(size_t n, Setup setup, Body body, uint64_t& dig) {
+    int reps    = n < 100000 ? 5 : n < 10000000 ? 3 : 1;
+    timing best = {1e300, 0};
+    for (int r = 0; r < reps; r++) {
+        unique_ptr<C> c = setup();
+        Clock::time_point start = Clock::now();
+        uint64_t c0             = cycles_now();
+        dig                     = body(*c);
+        uint64_t c1             = cycles_now();
+        double ns               = chrono::duration<double, nano>(Clock::now() - start).count();
+        if (ns < best.ns) {
+            best = {ns, c1 - c0};
+        }
+    }
+    return best;
+}
+
+void report(const result& r) {
+    double theirs = r.theirs.ns / r.ops, ours = r.ours.ns / r.ops;
+    printf("%-7s %-8s %-11s %10zu %11.2f %11.2f %7.2fx %9.1f %9.1f%s\n", r.container.c_str(), r.type.c_str(), r.op.c_str(), r.n,
+           theirs, ours, ours / theirs, (double)r.theirs.cycles / r.ops, (double)r.ours.cycles / r.ops,
+           r.match ? "" : "  DIGEST MISMATCH");
+    fflush(stdout);
+}
+
+//Runs one op on std (Theirs) then sjtu (Ours).
+template <class Theirs, class Ours, class Setup, class Body>
+void compare(const char* container, const char* type, const char* op, size_t n, size_t ops, Setup setup, Body body) {
+    result r;
+    r.container = container;
+    r.type      = type;
+    r.op        = op;
+    r.n         = n;
+    r.ops       = ops;
+    uint64_t a = 0, b = 0;
+    r.theirs   = measure<Theirs>(n, [&] { return setup(Theirs()); }, [&](Theirs& c) { return body(c); }, a);
+    r.ours     = measure<Ours>(n, [&] { return setup(Ours()); }, [&](Ours& c) { return body(c); }, b);
+    r.match    = a == b;
+    all_match  = all_match && r.match;
+    results.push_back(r);
+    report(r);
+}
+
+//setup helpers: an empty container, or one holding n elements.
+struct empty_of {
+    template <class C>
+    unique_ptr<C> operator()(C&&) const { return unique_ptr<C>(new C()); }
+};
+template <class T>
+struct filled {
+    size_t n;
+    template <class C>
+    unique_ptr<C> operator()(C&&) const {
+        unique_ptr<C> c(new C());
+        for (size_t i = 0; i < n; i++) {
+            c->push_back(make<T>(i));
+        }
+        return c;
+    }
+};
+template <class T>
+struct filled_map {
+    size_t n;
+    template <class C>
+    unique_ptr<C> operator()(C&&) const {
+        unique_ptr<C> c(new C());
+        for (size_t i = 0; i < n; i++) {
+            c->insert(typename C::value_type(key_of(i), make<T>(i)));
+        }
+        return c;
+    }
+};
+
+//* Benchmarks
+template <class T>
+void bench_vector(size_t n) {
+    typedef std::vector<T> S;
+    typedef sjtu::vector<T> O;
+    const char* t = type_name(make<T>(0));
+    compare<S, O>("vector", t, "push_back", n, n, empty_of(), [n](auto& v) {
+        for (size_t i = 0; i < n; i++) {
+            v.push_back(make<T>(i));
+        }
+        return (uint64_t)v.size();
+    });
+    compare<S, O>("vector", t, "index", n, n, filled<T>{n}, [n](auto& v) {
+        rng g(n);
+        uint64_t d = 0;
+        for (size_t i = 0; i < n; i++) {
+            d += digest(v[g() % n]);
+        }
+        return d;
+    });
+    compare<S, O>("vector", t, "iterate", n, n, filled<T>{n}, [](auto& v) {
+        uint64_t d = 0;
+        for (auto it = v.begin(); it != v.end(); ++it) {
+            d += digest(*it);
+        }
+        return d;
+    });
+    compare<S, O>("vector", t, "copy", n, n, filled<T>{n}, [](auto& v) {
+        typename remove_reference<decltype(v)>::type w(v);
+        return (uint64_t)w.size();
+    });
+    size_t k = min(n, (size_t)1000);
+    compare<S, O>("vector", t, "insert", n, k, filled<T>{n}, [k](auto& v) {
+        for (size_t i = 0; i < k; i++) {
+            v.insert(v.begin() + (int)(v.size() / 2), make<T>(i));
+        }
+        return (uint64_t)v.size();
+    });
+    compare<S, O>("vector", t, "pop_back", n, n, filled<T>{n}, [n](auto& v) {
+        for (size_t i = 0; i < n; i++) {
+            v.pop_back();
+        }
+        return (uint64_t)v.size();
+    });
+}
+
+template <class T>
+void bench_deque(size_t n) {
+    typedef std::deque<T> S;
+    typedef sjtu::deque<T> O;
+    const char* t = type_name(make<T>(0));
+    compare<S, O>("deque", t, "push_back", n, n, empty_of(), [n](auto& q) {
+        for (size_t i = 0; i < n; i++) {
+            q.push_back(make<T>(i));
+        }
+        return (uint64_t)q.size();
+    });
+    compare<S, O>("deque", t, "push_front", n, n, empty_of(), [n](auto& q) {
+        for (size_t i = 0; i < n; i++) {
+            q.push_front(make<T>(i));
+        }
+        return (uint64_t)q.size();
+    });
+    compare<S, O>("deque", t, "index", n, n, filled<T>{n}, [n](auto& q) {
+        rng g(n);
+        uint64_t d = 0;
+        for (size_t i = 0; i < n; i++) {
+            d += digest(q[g() % n]);
+        }
+        return d;
+    });
+    compare<S, O>("deque", t, "iterate", n, n, filled<T>{n}, [](auto& q) {
+        uint64_t d = 0;
+        for (auto it = q.begin(); it != q.end(); ++it) {
+            d += digest(*it);
+        }
+        return d;
+    });
+    size_t k = min(n, (size_t)1000);
+    compare<S, O>("deque", t, "insert", n, k, filled<T>{n}, [k](auto& q) {
+        rng g(k);
+        for (size_t i = 0; i < k; i++) {
+            q.insert(q.begin() + (int)(g() % (q.size() + 1)), make<T>(i));
+        }
+        return (uint64_t)q.size();
+    });
+    compare<S, O>("deque", t, "pop_front", n, n, filled<T>{n}, [n](auto& q) {
+        for (size_t i = 0; i < n; i++) {
+            q.pop_front();
+        }
+        return (uint64_t)q.size();
+    });
+}
+
+template <class T>
+void bench_map(size_t n) {
+    typedef std::map<int, T> S;
+    typedef sjtu::map<int, T> O;
+    const char* t = type_name(make<T>(0));
+    compare<S, O>("map", t, "insert", n, n, empty_of(), [n](auto& m) {
+        typedef typename remove_reference<decltype(m)>::type::value_type value_type;
+        for (size_t i = 0; i < n; i++) {
+            m.insert(value_type(key_of(i), make<T>(i)));
+        }
+        return (uint64_t)m.size();
+    });
+    compare<S, O>("map", t, "find", n, n, filled_map<T>{n}, [n](auto& m) {
+        rng g(n);
+        uint64_t d = 0;
+        for (size_t i = 0; i < n; i++) {
+            auto it = m.find(key_of(g() % n));
+            d += it == m.end() ? 0 : digest(it->second);
+        }
+        return d;
+    });
+    compare<S, O>("map", t, "iterate", n, n, filled_map<T>{n}, [](auto& m) {
+        uint64_t d = 0;
+        for (auto it = m.begin(); it != m.end(); ++it) {
+            d += (uint64_t)it->first + digest(it->second);
+        }
+        return d;
+    });
+    compare<S, O>("map", t, "erase", n, n, filled_map<T>{n}, [n](auto& m) {
+        //every key once, in an order unrelated to the keys.
+        for (size_t i = 0; i < n; i++) {
+            m.erase(m.find(key_of((i * 7919) % n)));
+        }
+        return (uint64_t)m.size();
+    });
+}
+
+//* Output
+string json_escape(const string& s) {
+    string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+void write_json(const char* file) {
+    FILE* f = fopen(file, "w");
+    if (f == nullptr) {
+        printf("cannot write %s\n", file);
+        return;
+    }
+    char when[32];
+    time_t now = time(nullptr);
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(f, "{\n  \"time\": \"%s\",\n  \"compiler\": \"%s\",\n  \"results\": [\n", when, json_escape(__VERSION__).c_str());
+    for (size_t i = 0; i < results.size(); i++) {
+        const result& r = results[i];
+        fprintf(f,
+                "    {\"container\": \"%s\", \"type\": \"%s\", \"op\": \"%s\", \"n\": %zu, \"ops\": %zu, "
+                "\"std_ns\": %.0f, \"sjtu_ns\": %.0f, \"std_cycles\": %llu, \"sjtu_cycles\": %llu, "
+                "\"std_ns_per_op\": %.3f, \"sjtu_ns_per_op\": %.3f, \"ratio\": %.4f, \"match\": %s}%s\n",
+                r.container.c_str(), r.type.c_str(), r.op.c_str(), r.n, r.ops, r.theirs.ns, r.ours.ns,
+                (unsigned long long)r.theirs.cycles, (unsigned long long)r.ours.cycles, r.theirs.ns / r.ops,
+                r.ours.ns / r.ops, r.ours.ns / r.theirs.ns, r.match ? "true" : "false", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+//* Driver
+size_t max_n    = 1000000;
+size_t budget   = (size_t)2048 << 20;
+string only, only_type;
+
+template <class T>
+void bench_type() {
+    const char* t = type_name(make<T>(0));
+    if (!only_type.empty() && only_type != t) {
+        return;
+    }
+    //a copy, or std and sjtu side by side, may hold twice the elements; the map adds about 64 bytes a node.
+    for (size_t n = 1000; n <= max_n; n *= 10) {
+        if ((only.empty() || only == "vector") && 2 * n * footprint<T>() <= budget) {
+            bench_vector<T>(n);
+        }
+        if ((only.empty() || only == "deque") && 2 * n * (footprint<T>() + 48) <= budget) {
+            bench_deque<T>(n);
+        }
+        if ((only.empty() || only == "map") && 2 * n * (footprint<T>() + 64) <= budget) {
+            bench_map<T>(n);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const char* json = "bench.json";
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--max")) {
+            max_n = (size_t)atof(argv[i + 1]);
+        } else if (!strcmp(argv[i], "--budget")) {
+            budget = (size_t)atoll(argv[i + 1]) << 20;
+        } else if (!strcmp(argv[i], "--only")) {
+            only = argv[i + 1];
+        } else if (!strcmp(argv[i], "--type")) {
+            only_type = argv[i + 1];
+        } else if (!strcmp(argv[i], "--json")) {
+            json = argv[i + 1];
+        } else {
+            printf("unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    printf("%-7s %-8s %-11s %10s %11s %11s %8s %9s %9s\n", "", "type", "op", "n", "std ns/op", "sjtu ns/op", "sjtu/std",
+           "std cyc", "sjtu cyc");
+    bench_type<int>();
+    bench_type<Integer>();
+    bench_type<Matrix<double>>();
+    bench_type<Bint>();
+    write_json(json);
+    return all_match ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "../vector/data/class-bint.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//  Util::Bint multiplication against the schoolbook routine it replaced.
+//  For each size (in base 10000 limbs, both operands, then a lopsided pair) both multiply the same
+//  random numbers; the products are compared digit by digit and the time of each is printed.
+//  The old routine runs on base 10000 limbs read back from the decimal form, the conversion is not timed.
+//
+//  usage: ./bint_mul [max limbs = 65536] [old max limbs = 16384] [seed = 1]
+//  The old routine is quadratic, above its max only the new one runs.
+//
+//  g++ -o bint_mul bint_mul.cpp -O2 -std=c++14
+using namespace std;
+typedef chrono::steady_clock Clock;
+
+unsigned long long state;
+unsigned long long rng() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+string random_number(size_t limbs) {
+    string s(1, '1' + rng() % 9);
+    for (size_t i = 1; i < limbs * 4; i++)
+        s += char('0' + rng() % 10);
+    return s;
+}
+
+string to_string(const Util::Bint& b) {
+    ostringstream os;
+    os << b;
+    return os.str();
+}
+
+//limbs, lowest first, of a decimal string.
+vector<int> limbs_of(const string& s) {
+    vector<int> r;
+    for (long long end = s.size(); end > 0; end -= 4) {
+        long long begin = max(0LL, end - 4);
+        r.push_back(atoi(s.substr(begin, end - begin).c_str()));
+    }
+    return r;
+}
+
+//the loop operator* used before, on the same layout.
+vector<int> old_multiply(const vector<int>& lhs, const vector<int>& rhs) {
+    vector<int> result(lhs.size() + rhs.size() + 2, 0);
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        for (size_t j = 0; j < rhs.size(); ++j) {
+            long long tmp = result[i + j] + static_cast<long long>(lhs[i]) * rhs[j];
+            if (tmp >= 10000) {
+                result[i + j] = tmp % 10000;
+                result[i + j + 1] += static_cast<int>(tmp / 10000);
+            } else {
+                result[i + j] = tmp;
+            }
+        }
+    }
+    size_t length = lhs.size() + rhs.size() - 1;
+    while (result[length] > 0)
+        ++length;
+    while (length > 1 && result[length - 1] == 0)
+        --length;
+    result.resize(length);
+    return result;
+}
+
+string decimal(const vector<int>& limbs) {
+    string s = to_string(limbs.back());
+    char buf[8];
+    for (long long i = (long long)limbs.size() - 2; i >= 0; --i) {
+        snprintf(buf, sizeof(buf), "%04d", limbs[i]);
+        s += buf;
+    }
+    return s;
+}
+
+//base 10000 limbs of a number with about this many 16 bit digits, the unit of the switch points.
+size_t limbs_for(size_t digits) {
+    return digits * 1204 / 1000;
+}
+
+double since(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//repeat small sizes so that each timing is at least ~0.1s.
+bool run(size_t n, size_t m, size_t old_max) {
+    Util::Bint a(random_number(n)), b(random_number(m));
+    string as = to_string(a), bs = to_string(b);
+
+    Util::Bint product;
+    size_t rounds = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        product = a * b;
+        ++rounds;
+    } while (since(start) < 0.1);
+    double now = since(start) / rounds;
+    string got = to_string(product);
+
+    if (max(n, m) > old_max) {
+        printf("%8zu x %-8zu %12.3f %12s %9s  %s\n", n, m, now * 1e3, "-", "-", "unchecked");
+        return true;
+    }
+    vector<int> la = limbs_of(as), lb = limbs_of(bs), expect;
+    rounds = 0;
+    start  = Clock::now();
+    do {
+        expect = old_multiply(la, lb);
+        ++rounds;
+    } while (since(start) < 0.1);
+    double old = since(start) / rounds;
+    bool same  = decimal(expect) == got;
+    printf("%8zu x %-8zu %12.3f %12.3f %8.1fx  %s\n", n, m, now * 1e3, old * 1e3, old / now, same ? "same" : "DIFFERENT");
+    return same;
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_limbs = argc > 1 ? atoll(argv[1]) : 65536;
+    size_t old_max   = argc > 2 ? atoll(argv[2]) : 16384;
+    state            = argc > 3 ? atoll(argv[3]) : 1;
+    state            = state * 0x9e3779b97f4a7c15ull | 1;
+    bool ok          = true;
+    printf("%19s %12s %12s %9s\n", "limbs", "new (ms)", "old (ms)", "speedup");
+    for (size_t n = 4; n <= max_limbs; n <<= 1)
+        ok &= run(n, n, old_max);
+    //lopsided, and sizes around the switch points.
+    for (size_t m : {limbs_for(2 * Util::SCHOOL_LIMBS) - 2, limbs_for(2 * Util::SCHOOL_LIMBS) + 2, limbs_for(Util::NTT_MIN) - 2,
+                     limbs_for(Util::NTT_MIN) + 2, (size_t)1000})
+        if (m <= max_limbs)
+            ok &= run(max_limbs / 4 > m ? max_limbs / 4 : m, m, old_max);
+    if (!ok) {
+        printf("products differ\n");
+        return 1;
+    }
+    return 0;
+}
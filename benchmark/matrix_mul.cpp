@@ -0,0 +1,114 @@
+#include "../vector/data/class-matrix.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+//  Diamond::Matrix multiplication against the i-j-k loop it replaced.
+//  For each size n both multiply the same random n x n matrices; the products are compared
+//  and the time of each is printed, with GFLOPS (2n^3 / time) for the new one.
+//
+//  usage: ./matrix_mul [max n = 1024] [old max n = 512] [double|float|int = double]
+//  The old loop strides down columns of b, above its max only the new one runs.
+//
+//  g++ -o matrix_mul matrix_mul.cpp -O2 -std=c++14
+//  add -mavx2 -mfma, -mavx512f or -march=native for the vector kernels.
+using namespace std;
+using Diamond::Matrix;
+typedef chrono::steady_clock Clock;
+
+unsigned long long state = 88172645463325252ull;
+unsigned long long rng() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+//small integers, so that every type gets exact products whatever the order of the sums.
+template <class T>
+Matrix<T> random_matrix(size_t n) {
+    Matrix<T> m(n, n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            m[i][j] = (T)((long long)(rng() % 17) - 8);
+    return m;
+}
+
+//the loop operator* used before.
+template <class T>
+Matrix<T> old_multiply(const Matrix<T>& a, const Matrix<T>& b) {
+    Matrix<T> c(a.RowSize(), b.ColSize(), 0);
+    for (size_t i = 0; i < a.RowSize(); ++i)
+        for (size_t j = 0; j < b.ColSize(); ++j)
+            for (size_t k = 0; k < a.ColSize(); ++k)
+                c[i][j] += a[i][k] * b[k][j];
+    return c;
+}
+
+double since(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//repeat small sizes so that each timing is at least ~0.1s.
+template <class T>
+bool run(size_t n, size_t old_max) {
+    Matrix<T> a = random_matrix<T>(n), b = random_matrix<T>(n), c;
+    size_t rounds = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        c = a * b;
+        ++rounds;
+    } while (since(start) < 0.1);
+    double now = since(start) / rounds;
+    double gflops = 2.0 * n * n * n / now / 1e9;
+    if (n > old_max) {
+        printf("%6zu %12.3f %8.2f %12s %9s  %s\n", n, now * 1e3, gflops, "-", "-", "unchecked");
+        return true;
+    }
+    Matrix<T> expect;
+    rounds = 0;
+    start  = Clock::now();
+    do {
+        expect = old_multiply(a, b);
+        ++rounds;
+    } while (since(start) < 0.1);
+    double old = since(start) / rounds;
+    bool same  = c == expect;
+    printf("%6zu %12.3f %8.2f %12.3f %8.1fx  %s\n", n, now * 1e3, gflops, old * 1e3, old / now, same ? "same" : "DIFFERENT");
+    return same;
+}
+
+template <class T>
+bool run_all(size_t max_n, size_t old_max) {
+    bool ok = true;
+    for (size_t n = 16; n <= max_n; n <<= 1)
+        ok &= run<T>(n, old_max);
+    //sizes that leave partial tiles and blocks.
+    for (size_t n : {(size_t)100, (size_t)257, (size_t)1000})
+        if (n <= max_n)
+            ok &= run<T>(n, old_max);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_n   = argc > 1 ? atoll(argv[1]) : 1024;
+    size_t old_max = argc > 2 ? atoll(argv[2]) : 512;
+    string type    = argc > 3 ? argv[3] : "double";
+    printf("%6s %12s %8s %12s %9s\n", "n", "new (ms)", "GFLOPS", "old (ms)", "speedup");
+    bool ok;
+    if (type == "float")
+        ok = run_all<float>(max_n, old_max);
+    else if (type == "int")
+        ok = run_all<int>(max_n, old_max);
+    else
+        ok = run_all<double>(max_n, old_max);
+    if (!ok) {
+        printf("products differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "../vector/data/class-matrix.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+//  Diamond::Matrix multiplication and Pow on 1, 2, 4, ... threads (Diamond::SetThreads).
+//  For each thread count it times an n x n product and two powers: one of an n x n matrix,
+//  whose products are split over the threads, and one of a small matrix, whose result and
+//  square products run side by side. Every result is compared with the one thread result.
+//
+//  usage: ./matrix_threads [n = 1024] [max threads = hardware threads] [small n = 96] [exponent = 63]
+//
+//  g++ -o matrix_threads matrix_threads.cpp -O2 -std=c++14 -pthread
+//  add -mavx2 -mfma, -mavx512f or -march=native for the vector kernels.
+using namespace std;
+using Diamond::Matrix;
+typedef chrono::steady_clock Clock;
+
+unsigned long long state = 88172645463325252ull;
+unsigned long long rng() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+//entries in {-1, 0, 1} scaled so that powers stay finite and every sum is exact.
+Matrix<double> random_matrix(size_t n, double scale) {
+    Matrix<double> m(n, n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            m[i][j] = ((long long)(rng() % 3) - 1) * scale;
+    return m;
+}
+
+double since(Clock::time_point start) {
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//seconds per call of f, repeated for at least ~0.2s.
+template <class F>
+double timed(F f) {
+    size_t rounds = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        f();
+        ++rounds;
+    } while (since(start) < 0.2);
+    return since(start) / rounds;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n           = argc > 1 ? atoll(argv[1]) : 1024;
+    size_t max_threads = argc > 2 ? atoll(argv[2]) : max(1u, thread::hardware_concurrency());
+    size_t small       = argc > 3 ? atoll(argv[3]) : 96;
+    size_t exponent    = argc > 4 ? atoll(argv[4]) : 63;
+    vector<size_t> counts;
+    for (size_t t = 1; t < max_threads; t <<= 1)
+        counts.push_back(t);
+    counts.push_back(max_threads);
+
+    //powers of 2 keep the entries of the powers exact.
+    Matrix<double> a = random_matrix(n, 1.0), b = random_matrix(n, 1.0);
+    Matrix<double> big = random_matrix(n, 1.0 / 1024), little = random_matrix(small, 1.0 / 128);
+    Matrix<double> product, big_pow, little_pow, expect_product, expect_big, expect_little;
+    double base_mul = 0, base_big = 0, base_little = 0;
+    bool ok = true;
+    printf("%7s %10s %8s %7s %12s %7s %12s %7s\n", "threads", "mul (ms)", "GFLOPS", "speedup", "pow n (ms)", "speedup", "pow small", "speedup");
+    for (size_t threads : counts) {
+        Diamond::SetThreads(threads);
+        double mul = timed([&] { product = a * b; });
+        double pow_big = timed([&] { size_t e = 15; big_pow = Diamond::Pow(big, e); });
+        double pow_little = timed([&] { size_t e = exponent; little_pow = Diamond::Pow(little, e); });
+        if (threads == 1) {
+            base_mul = mul, base_big = pow_big, base_little = pow_little;
+            expect_product = product, expect_big = big_pow, expect_little = little_pow;
+        }
+        bool same = product == expect_product && big_pow == expect_big && little_pow == expect_little;
+        ok &= same;
+        printf("%7zu %10.2f %8.2f %6.2fx %12.2f %6.2fx %12.3f %6.2fx  %s\n", threads, mul * 1e3, 2.0 * n * n * n / mul / 1e9,
+               base_mul / mul, pow_big * 1e3, base_big / pow_big, pow_little * 1e3, base_little / pow_little, same ? "same" : "DIFFERENT");
+    }
+    if (!ok) {
+        printf("results differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -177,13 +177,88 @@ private:
     size_t _size;
     block *head, *tail;
 
+#ifdef __SJTU_STATS__
+public:
+    //What this deque has cost so far; kept per instance, copies start from zero.
+    struct statistics {
+        size_t allocations, deallocations;
+        size_t bytes_allocated, bytes_freed;
+        size_t splits, merges;
+        //at(): blocks walked in bl_at, nodes walked in no_at.
+        size_t lookups, block_steps, node_steps;
+    };
+    //called on every counted event with its value (bytes, block size, steps), if set.
+    typedef void (*trace_hook)(const void* who, const char* event, size_t value, void* arg);
+
+    statistics stats() const { return __stats; }
+    void reset_stats() { __stats = statistics(); }
+    void set_trace(trace_hook hook, void* arg = nullptr) {
+        __hook     = hook;
+        __hook_arg = arg;
+    }
+
+private:
+    mutable statistics __stats = statistics();
+    trace_hook __hook          = nullptr;
+    void* __hook_arg           = nullptr;
+
+    void __trace(const char* event, size_t value) const {
+        if (__hook != nullptr)
+            __hook(this, event, value, __hook_arg);
+    }
+#endif
+
+    //* Instrumentation: empty unless __SJTU_STATS__ is defined.
+    //an element is a node plus its T, a block comes with two sentinel nodes.
+    void __note_alloc(size_t elements, size_t blocks) {
+#ifdef __SJTU_STATS__
+        size_t bytes = elements * (sizeof(node) + sizeof(T)) + blocks * (sizeof(block) + 2 * sizeof(node));
+        __stats.allocations += 2 * elements + 3 * blocks;
+        __stats.bytes_allocated += bytes;
+        __trace("alloc", bytes);
+#endif
+    }
+    void __note_free(size_t elements, size_t blocks) {
+#ifdef __SJTU_STATS__
+        size_t bytes = elements * (sizeof(node) + sizeof(T)) + blocks * (sizeof(block) + 2 * sizeof(node));
+        __stats.deallocations += 2 * elements + 3 * blocks;
+        __stats.bytes_freed += bytes;
+        __trace("free", bytes);
+#endif
+    }
+    //size: of the block after the split or merge.
+    void __note_split(size_t size) {
+#ifdef __SJTU_STATS__
+        ++__stats.splits;
+        __trace("split", size);
+#endif
+    }
+    void __note_merge(size_t size) {
+#ifdef __SJTU_STATS__
+        ++__stats.merges;
+        __trace("merge", size);
+#endif
+    }
+    void __note_walk(bool blocks, size_t steps) const {
+#ifdef __SJTU_STATS__
+        (blocks ? __stats.block_steps : __stats.node_steps) += steps;
+        __trace(blocks ? "bl_at" : "no_at", steps);
+#endif
+    }
+
     bool Collectable(size_t size) const { return size >= __CHUCKSIZE__ && (size * size >= __CHECKVALVE__ * _size); }
     block* bl_at(size_t& pos) const {
-        block* p = head->next;
+        block* p     = head->next;
+        size_t steps = 0;
         while (pos >= p->size) {
             pos -= p->size;
             p = p->next;
+            ++steps;
         }
+#ifdef __SJTU_STATS__
+        ++__stats.lookups;
+#endif
+        __note_walk(true, steps);
         return p;
     }
 
@@ -252,7 +327,7 @@ public:
         //DEST
         int operator-(const iterator& rhs) const {
             if (deq != rhs.deq) {
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             }
             size_t index = blk->re_at(pos), rindex = rhs.blk->re_at(rhs.pos);
             block *lp = blk, *rp = rhs.blk, *tmp = deq->head->next;
@@ -304,7 +379,7 @@ public:
 
         T& operator*() const {
             if (!blk->exist(pos) || blk->head == pos || blk->tail == pos) {
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             }
             return *(pos->data);
         }
@@ -388,7 +463,7 @@ public:
         //DIST
         int operator-(const const_iterator& rhs) const {
             if (deq != rhs.deq) {
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             }
             size_t index = blk->re_at(pos), rindex = rhs.blk->re_at(rhs.pos);
             block *lp = blk, *rp = rhs.blk, *tmp = deq->head->next;
@@ -437,10 +512,10 @@ public:
         }
         T& operator*() const {
             if (!blk->exist(pos)) {
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             }
             if (blk->head == pos || blk->tail == pos) {
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             }
             return *(pos->data);
         }
@@ -469,61 +544,72 @@ public:
         first->last  = head;
         first->next  = tail;
         tail->last   = first;
+        __note_alloc(0, 3);
     }
     deque(const deque& other) : _size(other._size), head(new block()), tail(new block()) {
         block *nthis = head, *nother = other.head->next, *tmp;
+        size_t blocks = 2;
         while (nother != other.tail) {
             tmp         = nthis;
             nthis->next = new block(*nother);
             nthis       = nthis->next;
             nthis->last = tmp;
             nother      = nother->next;
+            ++blocks;
         }
         nthis->next = tail;
         tail->last  = nthis;
+        __note_alloc(_size, blocks);
     }
 
     ~deque() {
-        block* b = head;
+        block* b      = head;
+        size_t blocks = 1;
         while (b != tail) {
             b = b->next;
             delete b->last;
+            ++blocks;
         }
         delete tail;
+        __note_free(_size, blocks);
     }
     deque& operator=(const deque& other) {
         if (&other == this)
             return *this;
-        _size        = other._size;
         block *bthis = head->next, *bother = (other.head)->next, *tmp;
+        size_t blocks = 0;
         while (bthis != tail) {
             tmp   = bthis;
             bthis = bthis->next;
             delete tmp;
+            ++blocks;
         }
-        bthis = head;
+        __note_free(_size, blocks);
+        _size  = other._size;
+        bthis  = head;
+        blocks = 0;
         while (bother != other.tail) {
             tmp         = bthis;
             bthis->next = new block(*bother);
             bthis       = bthis->next;
             bthis->last = tmp;
             bother      = bother->next;
+            ++blocks;
         }
+        __note_alloc(_size, blocks);
         bthis->next = tail;
         tail->last  = bthis;
         return *this;
     }
     T& at(const size_t& pos) {
         if (pos >= _size)
-            throw index_out_of_bound();
-        size_t ppos = pos;
-        return bl_at(ppos)->at(ppos);
+            SJTU_THROW(index_out_of_bound());
+        return unchecked(pos);
     }
     const T& at(const size_t& pos) const {
         if (pos >= _size)
-            throw index_out_of_bound();
-        size_t ppos = pos;
-        return bl_at(ppos)->at(ppos);
+            SJTU_THROW(index_out_of_bound());
+        return unchecked(pos);
     }
     T& operator[](const size_t& pos) {
         return at(pos);
@@ -531,15 +617,35 @@ public:
     const T& operator[](const size_t& pos) const {
         return at(pos);
     }
+    //no bounds check: pos must be below size(). Still walks to the element.
+    T& unchecked(const size_t& pos) {
+        size_t ppos = pos;
+        block* p    = bl_at(ppos);
+        __note_walk(false, ppos);
+        return p->at(ppos);
+    }
+    const T& unchecked(const size_t& pos) const {
+        size_t ppos = pos;
+        block* p    = bl_at(ppos);
+        __note_walk(false, ppos);
+        return p->at(ppos);
+    }
+    //nullptr instead of an exception when pos is out of range.
+    T* try_get(const size_t& pos) {
+        return pos < _size ? &unchecked(pos) : nullptr;
+    }
+    const T* try_get(const size_t& pos) const {
+        return pos < _size ? &unchecked(pos) : nullptr;
+    }
 
     const T& front() const {
         if (_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         return head->next->front();
     }
     const T& back() const {
         if (_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         return tail->last->back();
     }
 
@@ -560,12 +666,16 @@ public:
     size_t size() const { return _size; }
 
     void clear() {
-        _size    = 0;
-        block* p = head->next;
+        block* p      = head->next;
+        size_t blocks = 0;
         while (p != tail) {
             p = p->next;
             delete p->last;
+            ++blocks;
         }
+        __note_free(_size, blocks);
+        __note_alloc(0, 1);
+        _size = 0;
         head->next       = new block();
         head->next->last = head;
         head->next->next = tail;
@@ -574,25 +684,30 @@ public:
 
     iterator insert(iterator pos, const T& value) {
         if ((pos.deq != this) || !(pos.blk->exist(pos.pos))) {
-            throw invalid_iterator();
+            SJTU_THROW(invalid_iterator());
         }
         pos.blk->insert(value, pos.pos, 0);
         _size++;
+        __note_alloc(1, 0);
         pos = iterator(this, pos.blk, pos.pos->last);
-        if (Collectable(pos.blk->size))
+        if (Collectable(pos.blk->size)) {
             pos.blk->split(pos.pos);
+            __note_alloc(0, 1);
+            __note_split(pos.blk->size);
+        }
         return pos;
     }
     iterator erase(iterator pos) {
         if (_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         if ((pos.deq != this) || !(pos.blk->exist(pos.pos))) {
-            throw invalid_iterator();
+            SJTU_THROW(invalid_iterator());
         }
         //lastent illegal iterator
         node* pnext = pos.pos->next;
         pos.blk->erase(pos.pos, 0);
         --_size;
+        __note_free(1, 0);
         if (pnext == pos.blk->tail && pos.blk->next != pos.deq->tail) {
             if (pos.blk->next != pos.deq->tail) {
                 pos.blk = pos.blk->next;
@@ -604,15 +719,20 @@ public:
         }
         pos.pos = pnext;
         //Here empty is processed.
-        if ((pos.blk->next != tail) && (pos.blk->size + pos.blk->next->size <= __CHUCKSIZE__))
+        if ((pos.blk->next != tail) && (pos.blk->size + pos.blk->next->size <= __CHUCKSIZE__)) {
             pos.blk->merge();
+            __note_free(0, 1);
+            __note_merge(pos.blk->size);
+        }
         return pos;
     }
 
     void push_back(const T& value) {
         ++_size;
+        __note_alloc(1, 0);
         block* p = tail->last;
         if (Collectable(tail->last->size)) {
+            __note_alloc(0, 1);
             p->next       = new block();
             p->next->last = p;
             p->next->next = tail;
@@ -626,10 +746,12 @@ public:
 
     void pop_back() {
         if (_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         --_size;
+        __note_free(1, 0);
         tail->last->pop_back();
         if (tail->last->size == 0 && tail->last->last != head) {
+            __note_free(0, 1);
             block* del             = tail->last;
             tail->last->last->next = tail;
             tail->last             = tail->last->last;
@@ -640,8 +762,10 @@ public:
 
     void push_front(const T& value) {
         ++_size;
+        __note_alloc(1, 0);
         block* p = head->next;
         if (Collectable(p->size)) {
+            __note_alloc(0, 1);
             head->next = new block();
             head->next->push_front(value);
             head->next->next       = p;
@@ -654,10 +778,12 @@ public:
 
     void pop_front() {
         if (_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         --_size;
+        __note_free(1, 0);
         head->next->pop_front();
         if (head->next->size == 0 && tail->last->last != head) {
+            __note_free(0, 1);
             block* p         = head->next;
             head->next       = head->next->next;
             head->next->last = head;
@@ -666,6 +792,8 @@ public:
         }
         if ((head->next->next != tail) && ((head->next->size + head->next->next->size) < __CHUCKSIZE__)) {
             head->next->merge();
+            __note_free(0, 1);
+            __note_merge(head->next->size);
         }
     }
 };
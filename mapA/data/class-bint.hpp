@@ -2,12 +2,23 @@
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
+#include <new>
 #include <vector>
 #include <stdexcept>
 
 namespace Util {
 
-const size_t MIN_CAPACITY = 2048;
+//Limbs are 32 bits, lowest first. A value of at most INLINE_LIMBS limbs (anything that fits
+//in 64 bits) is kept inside the object, a longer one gets exactly as many limbs as it needs.
+const size_t INLINE_LIMBS = 2;
+//operator* multiplies limb by limb while the shorter operand has fewer than SCHOOL_LIMBS limbs.
+//Past that it cuts limbs into 16 bit digits and picks by the shorter operand's digits:
+//schoolbook below KARATSUBA_MIN, Karatsuba below NTT_MIN, NTT from there on (while the product
+//fits NTT_MAX digits).
+const size_t SCHOOL_LIMBS = 192;
+const size_t KARATSUBA_MIN = 48;
+const size_t NTT_MIN = 1536;
+const size_t NTT_MAX = size_t(1) << 23;
 
 class Bint {
     class NewSpaceFailed : public std::runtime_error {
@@ -18,13 +29,39 @@ class Bint {
     public:
         BadCast();
     };
+    typedef unsigned int limb;
+    typedef unsigned long long u64;
+
+    //0 is one zero limb and never minus.
     bool isMinus = false;
-    size_t length;
-    int *data = nullptr;
-    size_t capacity = MIN_CAPACITY;
-    void _DoubleSpace();
-    void _SafeNewSpace(int *&p, const size_t &len);
+    size_t length = 1;
+    //0 while the limbs are inline.
+    size_t capacity = 0;
+    union {
+        limb *data;
+        limb local[INLINE_LIMBS];
+    };
+
+    limb *_Limbs() { return capacity ? data : local; }
+    const limb *_Limbs() const { return capacity ? data : local; }
+    //len zeroed limbs, inline when they fit. The old limbs are gone.
+    void _SafeNewSpace(const size_t &len);
+    void _Release();
+    //drops leading zero limbs, and the heap if the rest fits inline.
+    void _Trim();
+    void _SetMagnitude(u64 x);
     explicit Bint(const size_t &capa);
+
+    static int _CompareMagnitude(const Bint &lhs, const Bint &rhs);
+    //lhs + rhs, or lhs - rhs if flip.
+    static Bint _Add(const Bint &lhs, const Bint &rhs, bool flip);
+
+    //Convolution of digit arrays without carries: out[k] = sum a[i] * b[k - i], n + m entries.
+    //Exact while every sum fits in 64 bits; Karatsuba works modulo 2^64, which changes nothing then.
+    static void _Convolve(const u64 *a, size_t n, const u64 *b, size_t m, u64 *out);
+    static void _MulSchool(const u64 *a, size_t n, const u64 *b, size_t m, u64 *out);
+    static void _MulKaratsuba(const u64 *a, const u64 *b, size_t n, u64 *out, u64 *scratch);
+    static void _MulNTT(const u64 *a, size_t n, const u64 *b, size_t m, u64 *out);
 public:
     Bint();
     Bint(int x);
@@ -69,160 +106,156 @@ namespace Util {
 Bint::NewSpaceFailed::NewSpaceFailed() : std::runtime_error("No Enough Memory Space.") {}
 Bint::BadCast::BadCast() : std::invalid_argument("Cannot convert to a Bint object") {}
 
-void Bint::_SafeNewSpace(int *&p, const size_t &len)
+void Bint::_Release()
+{
+    if (capacity) {
+        delete[] data;
+        capacity = 0;
+    }
+}
+
+void Bint::_SafeNewSpace(const size_t &len)
+{
+    _Release();
+    if (len > INLINE_LIMBS) {
+        data = new (std::nothrow) limb[len];
+        if (data == nullptr) {
+            throw NewSpaceFailed();
+        }
+        capacity = len;
+        memset(data, 0, len * sizeof(limb));
+    } else {
+        memset(local, 0, sizeof(local));
+    }
+}
+
+void Bint::_Trim()
 {
-    if (p != nullptr) {
-        delete[] p;
-        p = nullptr;
+    const limb *p = _Limbs();
+    while (length > 1 && p[length - 1] == 0) {
+        --length;
+    }
+    if (length == 1 && p[0] == 0) {
+        isMinus = false;
     }
-    p = new int[len];
-    if (p == nullptr) {
-        throw NewSpaceFailed();
+    if (capacity && length <= INLINE_LIMBS) {
+        limb *heap = data;
+        capacity = 0;
+        memset(local, 0, sizeof(local));
+        memcpy(local, heap, length * sizeof(limb));
+        delete[] heap;
     }
-    memset(p, 0, len * sizeof(unsigned int));
 }
 
-void Bint::_DoubleSpace()
+void Bint::_SetMagnitude(u64 x)
 {
-    int *newMem = nullptr;
-    _SafeNewSpace(newMem, capacity << 1);
-    memcpy(newMem, data, capacity * sizeof(int));
-    delete[] data;
-    data = newMem;
-    capacity <<= 1;
+    local[0] = static_cast<limb>(x);
+    local[1] = static_cast<limb>(x >> 32);
+    length = local[1] ? 2 : 1;
 }
 
 Bint::Bint()
-    : length(1)
 {
-    _SafeNewSpace(data, capacity);
+    _SetMagnitude(0);
 }
 
 Bint::Bint(int x)
-    : length(0)
-{
-    _SafeNewSpace(data, capacity);
-    if (x < 0) {
-        isMinus = true;
-        x = -x;
-    }
-    while (x) {
-        data[length++] = x % 10000;
-        x /= 10000;
-    }
-    if (!length) {
-        length = 1;
-    }
-}
+    : Bint(static_cast<long long>(x)) {}
 
 Bint::Bint(long long x)
-    : length(0)
+    : isMinus(x < 0)
 {
-    _SafeNewSpace(data, capacity);
-    if (x < 0) {
-        isMinus = true;
-        x = -x;
-    }
-    while (x) {
-        data[length++] = static_cast<unsigned int>(x % 10000);
-        x /= 10000;
-    }
-    if (!length) {
-        length = 1;
-    }
+    //-x overflows for LLONG_MIN, the unsigned negation does not.
+    _SetMagnitude(x < 0 ? 0ULL - static_cast<u64>(x) : static_cast<u64>(x));
 }
 
 Bint::Bint(const size_t &capa)
-    : length(1)
 {
-    while (capacity < capa) {
-        capacity <<= 1;
-    }
-    _SafeNewSpace(data, capacity);
+    _SafeNewSpace(capa);
 }
 
 Bint::Bint(std::string x)
 {
-    while (x[0] == '-') {
+    size_t begin = 0;
+    while (begin < x.length() && x[begin] == '-') {
         isMinus = !isMinus;
-        x.erase(0, 1);
+        ++begin;
     }
-    while ((capacity << 2) <= x.length()) {
-        capacity <<= 1;
+    if (begin == x.length()) {
+        throw BadCast();
     }
-
-    _SafeNewSpace(data, capacity);
-
-    size_t mid = x.length() >> 1;
-    for (size_t i = 0; i < mid; ++i) {
-        std::swap(x[i], x[x.length() - 1 - i]);
+    for (size_t i = begin; i < x.length(); ++i) {
+        if (x[i] > '9' || x[i] < '0') {
+            throw BadCast();
+        }
     }
-
-    const static unsigned int pow10[4] = {1, 10, 100, 1000};
-    for (size_t i = 0; i < capacity; ++i) {
-        if ((i << 2) >= x.length()) {
-            length = i;
-            break;
+    size_t digits = x.length() - begin;
+    if (digits <= 19) {
+        u64 v = 0;
+        for (size_t i = begin; i < x.length(); ++i) {
+            v = v * 10 + (x[i] - '0');
         }
-        for (size_t j = 0; j < 4; ++j) {
-            if ((i << 2) + j >= x.length()) {
-                break;
-            }
-            if (x[(i << 2) + j] > '9' || x[(i << 2) + j] < '0') {
-                throw BadCast();
-            }
-            data[i] = data[i] + (x[(i << 2) + j] - '0') * pow10[j];
+        _SetMagnitude(v);
+        _Trim();
+        return;
+    }
+    //9 digits at a time from the top: value = value * 10^k + next k digits.
+    //log2(10) < 10 / 3, so digits * 10 / 96 + 1 limbs always suffice.
+    _SafeNewSpace(digits * 10 / 96 + 2);
+    limb *p = _Limbs();
+    length = 1;
+    size_t at = begin, chunk = digits % 9 ? digits % 9 : 9;
+    while (at < x.length()) {
+        u64 carry = 0, scale = 1;
+        for (size_t i = 0; i < chunk; ++i) {
+            carry = carry * 10 + (x[at + i] - '0');
+            scale *= 10;
+        }
+        at += chunk;
+        chunk = 9;
+        for (size_t i = 0; i < length; ++i) {
+            carry += p[i] * scale;
+            p[i] = static_cast<limb>(carry);
+            carry >>= 32;
+        }
+        if (carry) {
+            p[length++] = static_cast<limb>(carry);
         }
     }
+    _Trim();
 }
 
 Bint::Bint(const Bint &b)
-    : isMinus(b.isMinus), length(b.length), capacity(b.capacity)
+    : isMinus(b.isMinus), length(b.length)
 {
-    _SafeNewSpace(data, capacity);
-    memcpy(data, b.data, sizeof(unsigned int) * capacity);
+    _SafeNewSpace(length);
+    memcpy(_Limbs(), b._Limbs(), sizeof(limb) * length);
 }
 
 Bint::Bint(Bint &&b) noexcept
     : isMinus(b.isMinus), length(b.length), capacity(b.capacity)
 {
-    data = b.data;
-    b.data = nullptr;
+    if (capacity) {
+        data = b.data;
+    } else {
+        memcpy(local, b.local, sizeof(local));
+    }
+    //what is left behind is a valid 0.
+    b.capacity = 0;
+    b.isMinus = false;
+    b._SetMagnitude(0);
 }
 
 Bint &Bint::operator=(int x)
 {
-    memset(data, 0, sizeof(unsigned int) * capacity);
-    length = 0;
-    if (x < 0) {
-        isMinus = true;
-        x = -x;
-    }
-    while (x) {
-        data[length++] = x % 10000;
-        x /= 10000;
-    }
-    if (!length) {
-        length = 1;
-    }
-    return *this;
+    return *this = static_cast<long long>(x);
 }
 
 Bint &Bint::operator=(long long x)
 {
-    memset(data, 0, sizeof(unsigned int) * capacity);
-    length = 0;
-    if (x < 0) {
-        isMinus = true;
-        x = -x;
-    }
-    while (x) {
-        data[length++] = static_cast<unsigned int>(x % 10000);
-        x /= 10000;
-    }
-    if (!length) {
-        length = 1;
-    }
+    _Release();
+    isMinus = x < 0;
+    _SetMagnitude(x < 0 ? 0ULL - static_cast<u64>(x) : static_cast<u64>(x));
     return *this;
 }
 
@@ -231,11 +264,11 @@ Bint &Bint::operator=(const Bint &rhs)
     if (this == &rhs) {
         return *this;
     }
-    if (rhs.capacity > capacity) {
-        capacity = rhs.capacity;
-        _SafeNewSpace(data, capacity);
+    //the old heap is reused only if it is not much larger than needed.
+    if (rhs.length <= INLINE_LIMBS || capacity < rhs.length || capacity > 2 * rhs.length) {
+        _SafeNewSpace(rhs.length);
     }
-    memcpy(data, rhs.data, sizeof(unsigned int) * rhs.capacity);
+    memcpy(_Limbs(), rhs._Limbs(), sizeof(limb) * rhs.length);
     length = rhs.length;
     isMinus = rhs.isMinus;
     return *this;
@@ -246,11 +279,18 @@ Bint &Bint::operator=(Bint &&rhs) noexcept
     if (this == &rhs) {
         return *this;
     }
-    capacity = rhs.capacity;
-    length = rhs.length;
+    _Release();
     isMinus = rhs.isMinus;
-    data = rhs.data;
-    rhs.data = nullptr;
+    length = rhs.length;
+    capacity = rhs.capacity;
+    if (capacity) {
+        data = rhs.data;
+    } else {
+        memcpy(local, rhs.local, sizeof(local));
+    }
+    rhs.capacity = 0;
+    rhs.isMinus = false;
+    rhs._SetMagnitude(0);
     return *this;
 }
 
@@ -264,17 +304,38 @@ std::istream &operator>>(std::istream &is, Bint &b)
 
 std::ostream &operator<<(std::ostream &os, const Bint &b)
 {
-    if (b.data == nullptr) {
-        return os;
-    }
-    if (b.isMinus && (b.length > 1 || b.data[0] != 0)) {
+    if (b.isMinus) {
         os << "-";
     }
-    os << b.data[b.length - 1];
-    for (long long i = b.length - 2LL; i >= 0; --i) {
-        os << std::setw(4) << std::setfill('0') << b.data[i];
+    const Bint::limb *p = b._Limbs();
+    if (b.length <= INLINE_LIMBS) {
+        return os << (b.length == 2 ? static_cast<Bint::u64>(p[1]) << 32 | p[0] : p[0]);
+    }
+    //9 digits at a time from the bottom, dividing a copy by 10^9 until it is gone.
+    std::vector<Bint::limb> rest(p, p + b.length);
+    std::vector<Bint::limb> chunks;
+    chunks.reserve(b.length * 32 / 29 + 1);
+    size_t len = b.length;
+    while (len > 0) {
+        Bint::u64 rem = 0;
+        for (size_t i = len; i-- > 0;) {
+            Bint::u64 cur = rem << 32 | rest[i];
+            rest[i] = static_cast<Bint::limb>(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        chunks.push_back(static_cast<Bint::limb>(rem));
+        while (len > 0 && rest[len - 1] == 0) {
+            --len;
+        }
     }
-    return os;
+    std::string s = std::to_string(chunks.back());
+    s.reserve(s.length() + (chunks.size() - 1) * 9);
+    char buf[16];
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        snprintf(buf, sizeof(buf), "%09u", chunks[i]);
+        s += buf;
+    }
+    return os << s;
 }
 
 Bint abs(const Bint &b)
@@ -287,67 +348,40 @@ Bint abs(const Bint &b)
 Bint abs(Bint &&b)
 {
     b.isMinus = false;
-    return b;
+    return std::move(b);
 }
 
-bool operator==(const Bint &lhs, const Bint &rhs)
+int Bint::_CompareMagnitude(const Bint &lhs, const Bint &rhs)
 {
-    if (lhs.isMinus != rhs.isMinus) {
-        return false;
-    }
     if (lhs.length != rhs.length) {
-        return false;
+        return lhs.length < rhs.length ? -1 : 1;
     }
-    for (size_t i = 0; i < lhs.length; ++i) {
-        if (lhs.data[i] != rhs.data[i]) {
-            return false;
+    const limb *l = lhs._Limbs(), *r = rhs._Limbs();
+    for (size_t i = lhs.length; i-- > 0;) {
+        if (l[i] != r[i]) {
+            return l[i] < r[i] ? -1 : 1;
         }
     }
-    return true;
+    return 0;
+}
+
+bool operator==(const Bint &lhs, const Bint &rhs)
+{
+    return lhs.isMinus == rhs.isMinus && Bint::_CompareMagnitude(lhs, rhs) == 0;
 }
 
 bool operator!=(const Bint &lhs, const Bint &rhs)
 {
-    if (lhs.isMinus != rhs.isMinus) {
-        return true;
-    }
-    if (lhs.length != rhs.length) {
-        return true;
-    }
-    for (size_t i = 0; i < lhs.length; ++i) {
-        if (lhs.data[i] != rhs.data[i]) {
-            return true;
-        }
-    }
-    return false;
+    return !(lhs == rhs);
 }
 
 bool operator<(const Bint &lhs, const Bint &rhs)
 {
     if (lhs.isMinus != rhs.isMinus) {
-        return !lhs.isMinus;
-    }
-    if (lhs.isMinus) {
-        if (lhs.length != rhs.length) {
-            return lhs.length > rhs.length;
-        }
-        for (long long i = lhs.length - 1; i >= 0; --i) {
-            if (lhs.data[i] != rhs.data[i]) {
-                return lhs.data[i] > rhs.data[i];
-            }
-        }
-        return false;
-    } else {
-        if (lhs.length != rhs.length) {
-            return lhs.length < rhs.length;
-        }
-        for (long long i = lhs.length - 1; i >= 0; --i) {
-            if (lhs.data[i] != rhs.data[i]) {
-                return lhs.data[i] < rhs.data[i];
-            }
-        }
-        return false;
+        return lhs.isMinus;
     }
+    int cmp = Bint::_CompareMagnitude(lhs, rhs);
+    return lhs.isMinus ? cmp > 0 : cmp < 0;
 }
 
 bool operator>(const Bint &lhs, const Bint &rhs)
@@ -357,160 +391,310 @@ bool operator>(const Bint &lhs, const Bint &rhs)
 
 bool operator<=(const Bint &lhs, const Bint &rhs)
 {
-    if (lhs.isMinus != rhs.isMinus) {
-        return !lhs.isMinus;
-    }
-    if (lhs.isMinus) {
-        if (lhs.length != rhs.length) {
-            return lhs.length > rhs.length;
-        }
-        for (long long i = lhs.length - 1; i >= 0; --i) {
-            if (lhs.data[i] != rhs.data[i]) {
-                return lhs.data[i] > rhs.data[i];
-            }
-        }
-        return true;
-    } else {
-        if (lhs.length != rhs.length) {
-            return lhs.length < rhs.length;
-        }
-        for (long long i = lhs.length - 1; i >= 0; --i) {
-            if (lhs.data[i] != rhs.data[i]) {
-                return lhs.data[i] < rhs.data[i];
-            }
-        }
-        return true;
-    }
+    return !(rhs < lhs);
 }
 
 bool operator>=(const Bint &lhs, const Bint &rhs)
 {
-    if (lhs.isMinus != rhs.isMinus) {
-        return lhs.isMinus;
-    }
-    if (lhs.isMinus) {
-        if (lhs.length != rhs.length) {
-            return lhs.length < rhs.length;
-        }
-        for (long long i = lhs.length - 1; i >= 0; --i) {
-            if (lhs.data[i] != rhs.data[i]) {
-                return lhs.data[i] < rhs.data[i];
-            }
-        }
-        return true;
-    } else {
-        if (lhs.length != rhs.length) {
-            return lhs.length > rhs.length;
-        }
-        for (long long i = lhs.length - 1; i >= 0; --i) {
-            if (lhs.data[i] != rhs.data[i]) {
-                return lhs.data[i] > rhs.data[i];
-            }
-        }
-        return true;
-    }
+    return !(lhs < rhs);
 }
 
-
-Bint operator+(const Bint &lhs, const Bint &rhs)
+Bint Bint::_Add(const Bint &lhs, const Bint &rhs, bool flip)
 {
-    if (lhs.isMinus == rhs.isMinus) {
-        size_t maxLen = std::max(lhs.length, rhs.length);
-        size_t expectLen = maxLen + 1;
-        Bint result(expectLen); // special constructor
-        for (size_t i = 0; i < maxLen; ++i) {
-            result.data[i] = lhs.data[i] + rhs.data[i];
+    bool rhsMinus = rhs.isMinus != flip;
+    const limb *l = lhs._Limbs(), *r = rhs._Limbs();
+    if (lhs.isMinus == rhsMinus) {
+        const limb *a = l, *b = r;
+        size_t n = lhs.length, m = rhs.length;
+        if (n < m) {
+            std::swap(a, b);
+            std::swap(n, m);
         }
-        for (size_t i = 0; i < maxLen; ++i) {
-            if (result.data[i] > 10000) {
-                result.data[i] -= 10000;
-                ++result.data[i + 1];
-            }
+        Bint result(n + 1);
+        limb *p = result._Limbs();
+        u64 carry = 0;
+        for (size_t i = 0; i < n; ++i) {
+            carry += static_cast<u64>(a[i]) + (i < m ? b[i] : 0);
+            p[i] = static_cast<limb>(carry);
+            carry >>= 32;
         }
-        result.length = result.data[maxLen] > 0 ? maxLen + 1 : maxLen;
+        p[n] = static_cast<limb>(carry);
+        result.length = n + 1;
         result.isMinus = lhs.isMinus;
+        result._Trim();
         return result;
-    } else {
-        if (lhs.isMinus) {
-            return rhs - abs(lhs);
-        } else {
-            return lhs - abs(rhs);
-        }
     }
+    //signs differ: the smaller magnitude comes off the larger one, which gives the sign.
+    int cmp = _CompareMagnitude(lhs, rhs);
+    if (cmp == 0) {
+        return Bint();
+    }
+    const Bint &big = cmp > 0 ? lhs : rhs, &small = cmp > 0 ? rhs : lhs;
+    const limb *a = big._Limbs(), *b = small._Limbs();
+    Bint result(big.length);
+    limb *p = result._Limbs();
+    u64 borrow = 0;
+    for (size_t i = 0; i < big.length; ++i) {
+        u64 sub = (i < small.length ? b[i] : 0) + borrow;
+        borrow = a[i] < sub;
+        p[i] = static_cast<limb>(a[i] - sub);
+    }
+    result.length = big.length;
+    result.isMinus = cmp > 0 ? lhs.isMinus : rhsMinus;
+    result._Trim();
+    return result;
+}
+
+Bint operator+(const Bint &lhs, const Bint &rhs)
+{
+    return Bint::_Add(lhs, rhs, false);
 }
 
 Bint operator-(const Bint &b)
 {
     Bint result(b);
-    result.isMinus = !result.isMinus;
+    result.isMinus = !result.isMinus && (result.length > 1 || result._Limbs()[0] != 0);
     return result;
 }
 
 Bint operator-(Bint &&b)
 {
-    b.isMinus = !b.isMinus;
-    return b;
+    b.isMinus = !b.isMinus && (b.length > 1 || b._Limbs()[0] != 0);
+    return std::move(b);
 }
 
 Bint operator-(const Bint &lhs, const Bint &rhs)
 {
-    if (lhs.isMinus == rhs.isMinus) {
-        if (lhs.isMinus) {
-            return -(abs(lhs) - abs(rhs));
-        } else {
-            if (lhs < rhs) {
-                return -(rhs - lhs);
-            }
-            Bint result(std::max(lhs.length, rhs.length));
-            for (size_t i = 0; i < lhs.length; ++i) {
-                result.data[i] = lhs.data[i] - rhs.data[i];
-            }
-            for (size_t i = 0; i < lhs.length; ++i) {
-                if (result.data[i] < 0) {
-                    result.data[i] += 10000;
-                    ++result.data[i + 1];
-                }
-            }
-            while (result.length > 1 && result.data[result.length - 1] == 0) {
-                --result.length;
+    return Bint::_Add(lhs, rhs, true);
+}
+
+void Bint::_MulSchool(const u64 *a, size_t n, const u64 *b, size_t m, u64 *out)
+{
+    std::fill(out, out + n + m, 0);
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < m; ++j) {
+            out[i + j] += a[i] * b[j];
+        }
+    }
+}
+
+//n by n into out[0, 2n); scratch takes 4n + what the halves need, 8n in all is enough.
+void Bint::_MulKaratsuba(const u64 *a, const u64 *b, size_t n, u64 *out, u64 *scratch)
+{
+    if (n < KARATSUBA_MIN) {
+        _MulSchool(a, n, b, n, out);
+        return;
+    }
+    size_t lo = n >> 1, hi = n - lo;
+    u64 *sa = scratch, *sb = scratch + hi, *mid = scratch + 2 * hi, *rest = scratch + 4 * hi;
+    //a0 * b0 and a1 * b1 go straight to where they belong.
+    _MulKaratsuba(a, b, lo, out, rest);
+    _MulKaratsuba(a + lo, b + lo, hi, out + 2 * lo, rest);
+    for (size_t i = 0; i < hi; ++i) {
+        sa[i] = a[lo + i] + (i < lo ? a[i] : 0);
+        sb[i] = b[lo + i] + (i < lo ? b[i] : 0);
+    }
+    _MulKaratsuba(sa, sb, hi, mid, rest);
+    for (size_t i = 0; i < 2 * lo; ++i) {
+        mid[i] -= out[i];
+    }
+    for (size_t i = 0; i < 2 * hi; ++i) {
+        mid[i] -= out[2 * lo + i];
+    }
+    for (size_t i = 0; i < 2 * hi; ++i) {
+        out[lo + i] += mid[i];
+    }
+}
+
+namespace {
+//two NTT primes with 3 as a primitive root; their product (~4.7e17) bounds the coefficients.
+const unsigned int NTT_P1 = 998244353, NTT_P2 = 469762049;
+
+unsigned int _PowMod(unsigned long long x, unsigned long long e, unsigned int p)
+{
+    unsigned long long r = 1;
+    x %= p;
+    while (e) {
+        if (e & 1) {
+            r = r * x % p;
+        }
+        x = x * x % p;
+        e >>= 1;
+    }
+    return static_cast<unsigned int>(r);
+}
+
+template <unsigned int P>
+void _NTT(std::vector<unsigned int> &f, bool inverse)
+{
+    size_t n = f.size();
+    for (size_t i = 1, j = 0; i < n; ++i) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(f[i], f[j]);
+        }
+    }
+    //twiddles with their Shoup quotients floor(w * 2^32 / P): v * w mod P without a division.
+    std::vector<unsigned int> w(n >> 1), ws(n >> 1);
+    for (size_t len = 2; len <= n; len <<= 1) {
+        unsigned long long step = _PowMod(3, (P - 1) / len, P);
+        if (inverse) {
+            step = _PowMod(step, P - 2, P);
+        }
+        size_t half = len >> 1;
+        w[0] = 1;
+        for (size_t k = 1; k < half; ++k) {
+            w[k] = static_cast<unsigned int>(w[k - 1] * step % P);
+        }
+        for (size_t k = 0; k < half; ++k) {
+            ws[k] = static_cast<unsigned int>((static_cast<unsigned long long>(w[k]) << 32) / P);
+        }
+        for (size_t i = 0; i < n; i += len) {
+            for (size_t k = 0; k < half; ++k) {
+                unsigned int u = f[i + k], x = f[i + k + half];
+                unsigned int q = static_cast<unsigned int>(static_cast<unsigned long long>(x) * ws[k] >> 32);
+                unsigned int v = x * w[k] - q * P;
+                v = v >= P ? v - P : v;
+                f[i + k] = u + v >= P ? u + v - P : u + v;
+                f[i + k + half] = u >= v ? u - v : u + P - v;
             }
-            return result;
         }
-    } else {
-        return lhs + (-rhs);
     }
+    if (inverse) {
+        unsigned long long inv = _PowMod(n, P - 2, P);
+        for (size_t i = 0; i < n; ++i) {
+            f[i] = static_cast<unsigned int>(f[i] * inv % P);
+        }
+    }
+}
+
+//a * b modulo P, cyclic of the given size (a power of two at least n + m).
+template <unsigned int P>
+std::vector<unsigned int> _CyclicProduct(const unsigned long long *a, size_t n, const unsigned long long *b, size_t m, size_t size)
+{
+    std::vector<unsigned int> fa(size, 0), fb(size, 0);
+    for (size_t i = 0; i < n; ++i) {
+        fa[i] = static_cast<unsigned int>(a[i] % P);
+    }
+    for (size_t i = 0; i < m; ++i) {
+        fb[i] = static_cast<unsigned int>(b[i] % P);
+    }
+    _NTT<P>(fa, false);
+    _NTT<P>(fb, false);
+    for (size_t i = 0; i < size; ++i) {
+        fa[i] = static_cast<unsigned int>(static_cast<unsigned long long>(fa[i]) * fb[i] % P);
+    }
+    _NTT<P>(fa, true);
+    return fa;
 }
+}
+
+void Bint::_MulNTT(const u64 *a, size_t n, const u64 *b, size_t m, u64 *out)
+{
+    size_t size = 1;
+    while (size < n + m) {
+        size <<= 1;
+    }
+    std::vector<unsigned int> r1 = _CyclicProduct<NTT_P1>(a, n, b, m, size);
+    std::vector<unsigned int> r2 = _CyclicProduct<NTT_P2>(a, n, b, m, size);
+    //x = r1 + P1 * t with t = (r2 - r1) / P1 mod P2.
+    const unsigned long long inv = _PowMod(NTT_P1, NTT_P2 - 2, NTT_P2);
+    for (size_t i = 0; i < n + m; ++i) {
+        unsigned long long t = (r2[i] + NTT_P2 - r1[i] % NTT_P2) % NTT_P2 * inv % NTT_P2;
+        out[i] = r1[i] + t * NTT_P1;
+    }
+}
+
+void Bint::_Convolve(const u64 *a, size_t n, const u64 *b, size_t m, u64 *out)
+{
+    if (n < m) {
+        std::swap(a, b);
+        std::swap(n, m);
+    }
+    //m is the shorter one from here.
+    if (m < KARATSUBA_MIN) {
+        _MulSchool(a, n, b, m, out);
+        return;
+    }
+    if (m >= NTT_MIN && n + m <= NTT_MAX) {
+        _MulNTT(a, n, b, m, out);
+        return;
+    }
+    //Karatsuba on m by m pieces of a, the last one padded with zeros.
+    std::fill(out, out + n + m, 0);
+    std::vector<u64> piece(m), part(2 * m), scratch(8 * m + 64);
+    for (size_t at = 0; at < n; at += m) {
+        size_t len = std::min(m, n - at);
+        std::copy(a + at, a + at + len, piece.begin());
+        std::fill(piece.begin() + len, piece.end(), 0);
+        _MulKaratsuba(piece.data(), b, m, part.data(), scratch.data());
+        for (size_t i = 0; i < len + m; ++i) {
+            out[at + i] += part[i];
+        }
+    }
+}
+
 
 Bint operator*(const Bint &lhs, const Bint &rhs)
 {
-    size_t expectLen = lhs.length + rhs.length + 2;
+    typedef Bint::u64 u64;
+    typedef Bint::limb limb;
+    const limb *l = lhs._Limbs(), *r = rhs._Limbs();
+    if (lhs.length == 1 && rhs.length == 1) {
+        Bint result;
+        result._SetMagnitude(static_cast<u64>(l[0]) * r[0]);
+        result.isMinus = lhs.isMinus != rhs.isMinus && (result.length > 1 || result.local[0] != 0);
+        return result;
+    }
+    size_t expectLen = lhs.length + rhs.length;
     Bint result(expectLen);
-    for (size_t i = 0; i < lhs.length; ++i) {
-        for (size_t j = 0; j < rhs.length; ++j) {
-            long long tmp = result.data[i + j] + static_cast<long long>(lhs.data[i]) * rhs.data[j];
-            if (tmp >= 10000) {
-                result.data[i + j] = tmp % 10000;
-                result.data[i + j + 1] += static_cast<int>(tmp / 10000);
-            } else {
-                result.data[i + j] = tmp;
+    limb *p = result._Limbs();
+    if (std::min(lhs.length, rhs.length) < SCHOOL_LIMBS) {
+        //row by row, a limb product plus what is there plus the carry fits in 64 bits.
+        for (size_t i = 0; i < lhs.length; ++i) {
+            u64 carry = 0;
+            for (size_t j = 0; j < rhs.length; ++j) {
+                carry += static_cast<u64>(l[i]) * r[j] + p[i + j];
+                p[i + j] = static_cast<limb>(carry);
+                carry >>= 32;
             }
+            p[i + rhs.length] = static_cast<limb>(carry);
+        }
+    } else {
+        //16 bit digits keep every coefficient below min(digits) * 2^32.
+        size_t n = 2 * lhs.length, m = 2 * rhs.length;
+        std::vector<u64> a(n), b(m), c(n + m);
+        for (size_t i = 0; i < lhs.length; ++i) {
+            a[2 * i] = l[i] & 0xffff;
+            a[2 * i + 1] = l[i] >> 16;
+        }
+        for (size_t i = 0; i < rhs.length; ++i) {
+            b[2 * i] = r[i] & 0xffff;
+            b[2 * i + 1] = r[i] >> 16;
+        }
+        Bint::_Convolve(a.data(), n, b.data(), m, c.data());
+        u64 carry = 0;
+        for (size_t i = 0; i < expectLen; ++i) {
+            carry += c[2 * i];
+            limb low = static_cast<limb>(carry & 0xffff);
+            carry >>= 16;
+            carry += c[2 * i + 1];
+            p[i] = low | static_cast<limb>(carry & 0xffff) << 16;
+            carry >>= 16;
         }
     }
-    result.length = lhs.length + rhs.length -1;
-    while (result.data[result.length] > 0) {
-        ++result.length;
-    }
-    while (result.length > 1 && result.data[result.length - 1] == 0) {
-        --result.length;
-    }
+    result.length = expectLen;
+    result.isMinus = lhs.isMinus != rhs.isMinus;
+    result._Trim();
     return result;
 }
 
 Bint::~Bint()
 {
-    if (data != nullptr) {
-        delete[] data;
-        data = nullptr;
-    }
+    _Release();
 }
 }
@@ -5,43 +5,106 @@
 #include <iomanip>
 #include <vector>
 #include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 namespace Diamond {
 
 template<typename _Td>
-class Matrix {
+class Matrix;
+
+/**
+ * Base of Matrix and of every lazy expression over matrices.
+ * operator+, operator-, operator* and operator/ build an expression instead of a result;
+ * it is evaluated once, straight into the matrix it is assigned to, so A * B + C * d
+ * allocates only the result. Sums of products accumulate into it with no temporaries.
+ * The expression refers to the named matrices it is built from and owns temporary ones,
+ * so auto e = f() * B is fine for as long as B lives.
+ *
+ * A derived _Expr provides
+ *   ELEMENTWISE          true if At() is cheap without Prepare() (no product inside)
+ *   RowSize(), ColSize()
+ *   At(idx)              element idx in row-major order, valid after Prepare()
+ *   Prepare()            evaluates the products inside that At() needs
+ *   StoreTo(dst)         dst[idx] = At(idx) for all idx
+ *   AddTo(dst, minus)    dst[idx] += At(idx), or -= if minus
+ *   Reads(p)             whether evaluating it reads the matrix whose data is p
+ */
+template<typename _Expr, typename _Td>
+class MatrixExpr {
+public:
+    const _Expr & Self() const
+    {
+        return static_cast<const _Expr &>(*this);
+    }
+    size_t RowSize() const
+    {
+        return Self().RowSize();
+    }
+    size_t ColSize() const
+    {
+        return Self().ColSize();
+    }
+};
+
+template<typename _Td>
+class Matrix : public MatrixExpr<Matrix<_Td>, _Td> {
 protected:
     size_t n_rows = 0;
     size_t n_cols = 0;
-    std::vector<std::vector<_Td>> data;
+    // row-major: element (i, j) is data[i * n_cols + j].
+    std::vector<_Td> data;
     class RowProxy {
-        std::vector<_Td> &row;
+        _Td *row;
     public:
-        RowProxy(std::vector<_Td> & _row) : row(_row) {}
+        RowProxy(_Td *_row) : row(_row) {}
         _Td & operator[](const size_t &pos)
         {
             return row[pos];
         }
     };
     class ConstRowProxy {
-        const std::vector<_Td> &row;
+        const _Td *row;
     public:
-        ConstRowProxy(const std::vector<_Td> &_row) : row(_row) {}
+        ConstRowProxy(const _Td *_row) : row(_row) {}
         const _Td & operator[](const size_t &pos) const
         {
             return row[pos];
         }
     };
+    template<typename _Expr>
+    void _Assign(const MatrixExpr<_Expr, _Td> &expr);
+    template<typename _Expr>
+    void _Accumulate(const MatrixExpr<_Expr, _Td> &expr, const bool &minus);
 public:
     Matrix() {};
     Matrix(const size_t &_n_rows, const size_t &_n_cols)
-        : n_rows(_n_rows), n_cols(_n_cols), data(std::vector<std::vector<_Td>>(n_rows, std::vector<_Td>(n_cols))) {}
+        : n_rows(_n_rows), n_cols(_n_cols), data(n_rows * n_cols) {}
     Matrix(const size_t &_n_rows, const size_t &_n_cols, const _Td &fillValue)
-        : n_rows(_n_rows), n_cols(_n_cols), data(std::vector<std::vector<_Td>>(n_rows, std::vector<_Td>(n_cols, fillValue))) {}
+        : n_rows(_n_rows), n_cols(_n_cols), data(n_rows * n_cols, fillValue) {}
     Matrix(const Matrix<_Td> &mat)
         : n_rows(mat.n_rows), n_cols(mat.n_cols), data(mat.data) {}
     Matrix(Matrix<_Td> &&mat) noexcept
-        : n_rows(mat.n_rows), n_cols(mat.n_cols), data(mat.data) {}
+        : n_rows(mat.n_rows), n_cols(mat.n_cols), data(std::move(mat.data))
+    {
+        mat.n_rows = mat.n_cols = 0;
+    }
+    template<typename _Expr>
+    Matrix(const MatrixExpr<_Expr, _Td> &expr)
+        : n_rows(expr.RowSize()), n_cols(expr.ColSize()), data(n_rows * n_cols)
+    {
+        expr.Self().StoreTo(data.data());
+    }
     Matrix<_Td> & operator=(const Matrix<_Td> &rhs)
     {
         this->n_rows = rhs.n_rows;
@@ -49,11 +112,49 @@ public:
         this->data = rhs.data;
         return *this;
     }
-    Matrix<_Td> & operator=(Matrix<_Td> &&rhs)
+    Matrix<_Td> & operator=(Matrix<_Td> &&rhs) noexcept
     {
-        this->n_rows = rhs.n_rows;
-        this->n_cols = rhs.n_cols;
-        this->data = rhs.data;
+        if (this != &rhs) {
+            this->n_rows = rhs.n_rows;
+            this->n_cols = rhs.n_cols;
+            this->data = std::move(rhs.data);
+            rhs.n_rows = rhs.n_cols = 0;
+            rhs.data.clear();
+        }
+        return *this;
+    }
+    template<typename _Expr>
+    Matrix<_Td> & operator=(const MatrixExpr<_Expr, _Td> &expr)
+    {
+        _Assign(expr);
+        return *this;
+    }
+    template<typename _Expr>
+    Matrix<_Td> & operator+=(const MatrixExpr<_Expr, _Td> &expr)
+    {
+        _Accumulate(expr, false);
+        return *this;
+    }
+    template<typename _Expr>
+    Matrix<_Td> & operator-=(const MatrixExpr<_Expr, _Td> &expr)
+    {
+        _Accumulate(expr, true);
+        return *this;
+    }
+    template<typename _Expr>
+    Matrix<_Td> & operator*=(const MatrixExpr<_Expr, _Td> &expr);
+    Matrix<_Td> & operator*=(const _Td &b)
+    {
+        for (_Td &x : data) {
+            x = x * b;
+        }
+        return *this;
+    }
+    Matrix<_Td> & operator/=(const double &b)
+    {
+        for (_Td &x : data) {
+            x = x / b;
+        }
         return *this;
     }
     inline const size_t & RowSize() const
@@ -66,159 +167,1003 @@ public:
     }
     RowProxy operator[](const size_t &Kth)
     {
-        return RowProxy(this->data[Kth]);
+        return RowProxy(this->data.data() + Kth * n_cols);
     }
     const ConstRowProxy operator[](const size_t &Kth) const
     {
-        return ConstRowProxy(this->data[Kth]);
+        return ConstRowProxy(this->data.data() + Kth * n_cols);
+    }
+    /**
+     * The RowSize() * ColSize() elements, row after row.
+     */
+    _Td * Data()
+    {
+        return this->data.data();
+    }
+    const _Td * Data() const
+    {
+        return this->data.data();
+    }
+    void TransposeInPlace();
+    /**
+     * this = a * b. The buffer is reused when it has the right size;
+     * a and b must not be this.
+     */
+    void AssignProduct(const Matrix<_Td> &a, const Matrix<_Td> &b);
+
+    // As an expression, a Matrix is a leaf.
+    static const bool ELEMENTWISE = true;
+    const _Td & At(const size_t &idx) const
+    {
+        return data[idx];
+    }
+    void Prepare() const {}
+    void StoreTo(_Td *dst) const
+    {
+        std::copy(data.begin(), data.end(), dst);
+    }
+    void AddTo(_Td *dst, const bool &minus) const
+    {
+        const size_t size = data.size();
+        if (minus) {
+            for (size_t i = 0; i < size; ++i) {
+                dst[i] = dst[i] - data[i];
+            }
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                dst[i] = dst[i] + data[i];
+            }
+        }
+    }
+    bool Reads(const _Td *p) const
+    {
+        return p == data.data();
     }
     ~Matrix() = default;
 };
 
+namespace __detail {
+
 /**
- * Sum of two matrics.
+ * Block sizes of the multiply. A KC x NC panel of b and an MC x KC block of a are packed
+ * into strips the kernel reads front to back; the block of a stays in L2 while the kernel
+ * walks the panel of b. MC is a multiple of every kernel's MR, NC of every NR.
  */
-template<typename _Td>
-Matrix<_Td> operator+(const Matrix<_Td> &a, const Matrix<_Td> &b)
+const size_t GEMM_KC = 256;
+const size_t GEMM_MC = 96;
+const size_t GEMM_NC = 2048;
+// below this many multiply-adds packing costs more than it saves.
+const size_t GEMM_SMALL = 32 * 32 * 32;
+const size_t TRANSPOSE_BLOCK = 32;
+/**
+ * Products with at least this many multiply-adds are split over the threads, as are
+ * those of non-arithmetic elements above GEMM_PARALLEL_OBJECT. When the blocks of a
+ * are too few to keep the threads busy they are also cut into GEMM_TILE_COLS or more
+ * columns, aiming at 2 pieces per thread.
+ */
+const size_t GEMM_PARALLEL = 128 * 128 * 128;
+const size_t GEMM_PARALLEL_OBJECT = 16 * 16 * 16;
+const size_t GEMM_TILE_COLS = 128;
+
+inline std::atomic<size_t> & ThreadSetting()
 {
-    if (a.RowSize() != b.RowSize() || a.ColSize() != b.ColSize()) {
-        throw std::invalid_argument("different matrics\'s sizes");
+    static std::atomic<size_t> threads(0);
+    return threads;
+}
+
+inline size_t ThreadCount()
+{
+    size_t threads = ThreadSetting();
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return threads == 0 ? 1 : threads;
+}
+
+/**
+ * Workers that run Run(count, job) together with the calling thread: each of them
+ * takes the next index in [0, count) until none is left. The workers are started
+ * the first time they are needed and wait on a condition variable between jobs.
+ * One job runs at a time; a Run from inside a job, or while another thread's job
+ * is running, just loops on the calling thread.
+ */
+class ThreadPool {
+    std::mutex lock;
+    std::mutex running;
+    std::condition_variable wake, finished;
+    std::vector<std::thread> workers;
+    const std::function<void(size_t)> *job = nullptr;
+    std::atomic<size_t> next;
+    size_t count = 0, active = 0, busy = 0, generation = 0;
+    std::exception_ptr error;
+    bool stop = false;
+
+    static bool & _InJob()
+    {
+        static thread_local bool inJob = false;
+        return inJob;
+    }
+    void _Work()
+    {
+        for (size_t idx; (idx = next.fetch_add(1)) < count;) {
+            try {
+                (*job)(idx);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
     }
-    Matrix<_Td> c(a.RowSize(), a.ColSize());
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < a.ColSize(); ++j) {
-            c[i][j] = a[i][j] + b[i][j];
+    void _Worker(const size_t id)
+    {
+        _InJob() = true;
+        size_t seen = 0;
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+            if (id >= active) {
+                continue;
+            }
+            guard.unlock();
+            _Work();
+            guard.lock();
+            if (--busy == 0) {
+                finished.notify_one();
+            }
         }
     }
-    return c;
-}
+public:
+    ThreadPool() : next(0) {}
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+    static ThreadPool & Instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+    void Run(const size_t &_count, const std::function<void(size_t)> &_job, const size_t &threads)
+    {
+        std::unique_lock<std::mutex> exclusive(running, std::defer_lock);
+        if (threads <= 1 || _count <= 1 || _InJob() || !exclusive.try_lock()) {
+            for (size_t idx = 0; idx < _count; ++idx) {
+                _job(idx);
+            }
+            return;
+        }
+        size_t helpers = std::min(threads, _count) - 1;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            while (workers.size() < helpers) {
+                workers.emplace_back(&ThreadPool::_Worker, this, workers.size());
+            }
+            job = &_job;
+            count = _count;
+            next = 0;
+            active = busy = helpers;
+            error = nullptr;
+            ++generation;
+        }
+        wake.notify_all();
+        _InJob() = true;
+        _Work();
+        _InJob() = false;
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [&] { return busy == 0; });
+        job = nullptr;
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+};
 
+/**
+ * x op s for one element. Each is a separate specialization so that a type only
+ * needs the operators its matrices actually use.
+ */
+template<char _Op>
+struct ElementOp;
+
+template<>
+struct ElementOp<'+'> {
+    template<typename _Td, typename _S>
+    static _Td Apply(const _Td &x, const _S &s)
+    {
+        return x + s;
+    }
+};
+
+template<>
+struct ElementOp<'-'> {
+    template<typename _Td, typename _S>
+    static _Td Apply(const _Td &x, const _S &s)
+    {
+        return x - s;
+    }
+};
+
+template<>
+struct ElementOp<'*'> {
+    template<typename _Td, typename _S>
+    static _Td Apply(const _Td &x, const _S &s)
+    {
+        return x * s;
+    }
+};
+
+template<>
+struct ElementOp<'/'> {
+    template<typename _Td, typename _S>
+    static _Td Apply(const _Td &x, const _S &s)
+    {
+        return x / s;
+    }
+};
+
+template<>
+struct ElementOp<'n'> {
+    template<typename _Td, typename _S>
+    static _Td Apply(const _Td &x, const _S &)
+    {
+        return -x;
+    }
+};
+
+/**
+ * One MR x NR tile of a product from packed strips:
+ * out[i * NR + j] = sum over k < kc of pa[k * MR + i] * pb[k * NR + j].
+ * The accumulators are meant to stay in registers.
+ */
 template<typename _Td>
-Matrix<_Td> operator-(const Matrix<_Td> &a, const Matrix<_Td> &b)
-{
-    if (a.RowSize() != b.RowSize() || a.ColSize() != b.ColSize()) {
-        throw std::invalid_argument("different matrics\'s sizes");
+struct GemmKernel {
+    static const size_t MR = 4;
+    static const size_t NR = 8;
+    static void Run(const size_t &kc, const _Td *pa, const _Td *pb, _Td *out)
+    {
+        _Td c0[NR] = {}, c1[NR] = {}, c2[NR] = {}, c3[NR] = {};
+        for (size_t k = 0; k < kc; ++k, pa += MR, pb += NR) {
+            const _Td a0 = pa[0], a1 = pa[1], a2 = pa[2], a3 = pa[3];
+            for (size_t j = 0; j < NR; ++j) {
+                c0[j] += a0 * pb[j];
+                c1[j] += a1 * pb[j];
+                c2[j] += a2 * pb[j];
+                c3[j] += a3 * pb[j];
+            }
+        }
+        for (size_t j = 0; j < NR; ++j) {
+            out[j] = c0[j];
+            out[NR + j] = c1[j];
+            out[2 * NR + j] = c2[j];
+            out[3 * NR + j] = c3[j];
+        }
     }
-    Matrix<_Td> c(a.RowSize(), a.ColSize());
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < a.ColSize(); ++j) {
-            c[i][j] = a[i][j] - b[i][j];
+};
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+/**
+ * 4 rows of 2 vectors each. The vector type, its lane count and the load, broadcast,
+ * multiply-add and store are all that differ between the instruction sets and between
+ * float, double and int.
+ */
+#define DIAMOND_GEMM_KERNEL(_Type, _Vec, _Lanes, _Load, _Set1, _MulAdd, _Store) \
+template<>                                                                      \
+struct GemmKernel<_Type> {                                                      \
+    static const size_t MR = 4;                                                 \
+    static const size_t NR = 2 * _Lanes;                                        \
+    static void Run(const size_t &kc, const _Type *pa, const _Type *pb, _Type *out) \
+    {                                                                           \
+        _Vec c00 = _Set1(0), c01 = _Set1(0), c10 = _Set1(0), c11 = _Set1(0);   \
+        _Vec c20 = _Set1(0), c21 = _Set1(0), c30 = _Set1(0), c31 = _Set1(0);   \
+        for (size_t k = 0; k < kc; ++k, pa += MR, pb += NR) {                   \
+            _Vec b0 = _Load(pb), b1 = _Load(pb + _Lanes);                       \
+            _Vec a = _Set1(pa[0]);                                              \
+            c00 = _MulAdd(a, b0, c00);                                          \
+            c01 = _MulAdd(a, b1, c01);                                          \
+            a = _Set1(pa[1]);                                                   \
+            c10 = _MulAdd(a, b0, c10);                                          \
+            c11 = _MulAdd(a, b1, c11);                                          \
+            a = _Set1(pa[2]);                                                   \
+            c20 = _MulAdd(a, b0, c20);                                          \
+            c21 = _MulAdd(a, b1, c21);                                          \
+            a = _Set1(pa[3]);                                                   \
+            c30 = _MulAdd(a, b0, c30);                                          \
+            c31 = _MulAdd(a, b1, c31);                                          \
+        }                                                                       \
+        _Store(out, c00);                                                       \
+        _Store(out + _Lanes, c01);                                              \
+        _Store(out + NR, c10);                                                  \
+        _Store(out + NR + _Lanes, c11);                                         \
+        _Store(out + 2 * NR, c20);                                              \
+        _Store(out + 2 * NR + _Lanes, c21);                                     \
+        _Store(out + 3 * NR, c30);                                              \
+        _Store(out + 3 * NR + _Lanes, c31);                                     \
+    }                                                                           \
+};
+
+#if defined(__AVX512F__)
+inline __m512i __MulAddEpi32(__m512i a, __m512i b, __m512i c)
+{
+    return _mm512_add_epi32(_mm512_mullo_epi32(a, b), c);
+}
+inline __m512i __LoadEpi32(const int *p)
+{
+    return _mm512_loadu_si512(p);
+}
+inline void __StoreEpi32(int *p, __m512i v)
+{
+    _mm512_storeu_si512(p, v);
+}
+
+DIAMOND_GEMM_KERNEL(double, __m512d, 8, _mm512_loadu_pd, _mm512_set1_pd, _mm512_fmadd_pd, _mm512_storeu_pd)
+DIAMOND_GEMM_KERNEL(float, __m512, 16, _mm512_loadu_ps, _mm512_set1_ps, _mm512_fmadd_ps, _mm512_storeu_ps)
+DIAMOND_GEMM_KERNEL(int, __m512i, 16, __LoadEpi32, _mm512_set1_epi32, __MulAddEpi32, __StoreEpi32)
+
+#else
+#if defined(__FMA__)
+inline __m256d __MulAddPd(__m256d a, __m256d b, __m256d c)
+{
+    return _mm256_fmadd_pd(a, b, c);
+}
+inline __m256 __MulAddPs(__m256 a, __m256 b, __m256 c)
+{
+    return _mm256_fmadd_ps(a, b, c);
+}
+#else
+inline __m256d __MulAddPd(__m256d a, __m256d b, __m256d c)
+{
+    return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+}
+inline __m256 __MulAddPs(__m256 a, __m256 b, __m256 c)
+{
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+}
+#endif
+inline __m256i __MulAddEpi32(__m256i a, __m256i b, __m256i c)
+{
+    return _mm256_add_epi32(_mm256_mullo_epi32(a, b), c);
+}
+inline __m256i __LoadEpi32(const int *p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+inline void __StoreEpi32(int *p, __m256i v)
+{
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+}
+
+DIAMOND_GEMM_KERNEL(double, __m256d, 4, _mm256_loadu_pd, _mm256_set1_pd, __MulAddPd, _mm256_storeu_pd)
+DIAMOND_GEMM_KERNEL(float, __m256, 8, _mm256_loadu_ps, _mm256_set1_ps, __MulAddPs, _mm256_storeu_ps)
+DIAMOND_GEMM_KERNEL(int, __m256i, 8, __LoadEpi32, _mm256_set1_epi32, __MulAddEpi32, __StoreEpi32)
+#endif
+#undef DIAMOND_GEMM_KERNEL
+#endif
+
+/**
+ * Rows [0, mc) and columns [0, kc) of a (row length lda) as strips of MR rows,
+ * each stored column after column. The last strip is padded with zeros.
+ */
+template<typename _Td, size_t MR>
+void PackA(const _Td *a, const size_t &lda, const size_t &mc, const size_t &kc, _Td *pa)
+{
+    for (size_t i = 0; i < mc; i += MR) {
+        size_t rows = std::min(MR, mc - i);
+        for (size_t k = 0; k < kc; ++k) {
+            for (size_t r = 0; r < MR; ++r) {
+                *pa++ = r < rows ? a[(i + r) * lda + k] : _Td(0);
+            }
         }
     }
-    return c;
 }
-template<typename _Td>
-bool operator==(const Matrix<_Td> &a, const Matrix<_Td> &b)
+
+/**
+ * Rows [0, kc) and columns [0, nc) of b (row length ldb) as strips of NR columns,
+ * each stored row after row. The last strip is padded with zeros.
+ */
+template<typename _Td, size_t NR>
+void PackB(const _Td *b, const size_t &ldb, const size_t &kc, const size_t &nc, _Td *pb)
 {
-    if (a.RowSize() != b.RowSize() || a.ColSize() != b.ColSize()) {
-        return false;
+    for (size_t j = 0; j < nc; j += NR) {
+        size_t cols = std::min(NR, nc - j);
+        for (size_t k = 0; k < kc; ++k) {
+            const _Td *row = b + k * ldb + j;
+            for (size_t q = 0; q < NR; ++q) {
+                *pb++ = q < cols ? row[q] : _Td(0);
+            }
+        }
     }
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < a.ColSize(); ++j) {
-            if (a[i][j] != b[i][j])
-                return false;
+}
+
+/**
+ * c += a * b (c -= a * b if _Sub), all row-major: a is m x p, b is p x n, c is m x n.
+ * The plain i-k-j loop, which already reads b and c along rows.
+ */
+template<bool _Sub, typename _Td>
+void GemmLoop(const size_t &m, const size_t &n, const size_t &p, const _Td *a, const _Td *b, _Td *c)
+{
+    for (size_t i = 0; i < m; ++i) {
+        _Td *ci = c + i * n;
+        for (size_t k = 0; k < p; ++k) {
+            const _Td x = a[i * p + k];
+            const _Td *bk = b + k * n;
+            for (size_t j = 0; j < n; ++j) {
+                ci[j] = ElementOp<_Sub ? '-' : '+'>::Apply(ci[j], x * bk[j]);
+            }
         }
     }
-    return true;
 }
 
+/**
+ * Whether Gemm splits an m x p by p x n product over the threads.
+ */
 template<typename _Td>
-Matrix<_Td> operator-(const Matrix<_Td> &mat)
+bool GemmParallel(const size_t &m, const size_t &n, const size_t &p)
 {
-    Matrix<_Td> result(mat.RowSize(), mat.ColSize());
-    for (size_t i = 0; i < mat.RowSize(); ++i) {
-        for (size_t j = 0; j < mat.ColSize(); ++j) {
-            result[i][j] = -mat[i][j];
+    size_t limit = std::is_arithmetic<_Td>::value ? GEMM_PARALLEL : GEMM_PARALLEL_OBJECT;
+    return m > 1 && m * n * p >= limit && ThreadCount() > 1;
+}
+
+// Types that are not arithmetic are not packed; a parallel product gives each thread rows of c.
+template<bool _Sub, typename _Td>
+void GemmPacked(const size_t &m, const size_t &n, const size_t &p, const _Td *a, const _Td *b, _Td *c, std::false_type)
+{
+    if (!GemmParallel<_Td>(m, n, p)) {
+        GemmLoop<_Sub>(m, n, p, a, b, c);
+        return;
+    }
+    const size_t threads = ThreadCount();
+    const size_t rows = (m + threads - 1) / threads;
+    ThreadPool::Instance().Run((m + rows - 1) / rows, [&](size_t t) {
+        size_t i = t * rows;
+        GemmLoop<_Sub>(std::min(rows, m - i), n, p, a + i * p, b, c + i * n);
+    }, threads);
+}
+
+/**
+ * The same through packed blocks and the kernel; small products skip the packing.
+ * On several threads each panel of b is packed by all of them together, then the
+ * blocks of a (cut across the columns too when there are too few of them) are
+ * shared out, each thread packing its own.
+ */
+template<bool _Sub, typename _Td>
+void GemmPacked(const size_t &m, const size_t &n, const size_t &p, const _Td *a, const _Td *b, _Td *c, std::true_type)
+{
+    if (m * n * p < GEMM_SMALL) {
+        GemmLoop<_Sub>(m, n, p, a, b, c);
+        return;
+    }
+    typedef GemmKernel<_Td> Kernel;
+    const size_t MR = Kernel::MR, NR = Kernel::NR;
+    const size_t threads = GemmParallel<_Td>(m, n, p) ? ThreadCount() : 1;
+    size_t kcMax = std::min(GEMM_KC, p);
+    size_t mcMax = std::min(GEMM_MC, (m + MR - 1) / MR * MR);
+    size_t ncMax = std::min(GEMM_NC, (n + NR - 1) / NR * NR);
+    // every element is written by the packing before the kernel reads it.
+    std::unique_ptr<_Td[]> pb(new _Td[ncMax * kcMax]);
+    const size_t rowBlocks = (m + GEMM_MC - 1) / GEMM_MC;
+    for (size_t jc = 0; jc < n; jc += GEMM_NC) {
+        size_t nc = std::min(GEMM_NC, n - jc);
+        size_t strips = (nc + NR - 1) / NR;
+        size_t packCols = (strips + threads - 1) / threads * NR;
+        size_t colBlocks = std::min((2 * threads + rowBlocks - 1) / rowBlocks, std::max(nc / GEMM_TILE_COLS, static_cast<size_t>(1)));
+        size_t blockCols = (strips + colBlocks - 1) / colBlocks * NR;
+        colBlocks = (nc + blockCols - 1) / blockCols;
+        for (size_t pc = 0; pc < p; pc += GEMM_KC) {
+            size_t kc = std::min(GEMM_KC, p - pc);
+            ThreadPool::Instance().Run((nc + packCols - 1) / packCols, [&](size_t t) {
+                size_t j = t * packCols;
+                PackB<_Td, NR>(b + pc * n + jc + j, n, kc, std::min(packCols, nc - j), pb.get() + j * kc);
+            }, threads);
+            ThreadPool::Instance().Run(rowBlocks * colBlocks, [&](size_t t) {
+                size_t ic = t / colBlocks * GEMM_MC, mc = std::min(GEMM_MC, m - ic);
+                size_t jb = t % colBlocks * blockCols, je = std::min(nc, jb + blockCols);
+                std::unique_ptr<_Td[]> pa(new _Td[mcMax * kcMax]);
+                _Td out[MR * NR];
+                PackA<_Td, MR>(a + ic * p + pc, p, mc, kc, pa.get());
+                for (size_t jr = jb; jr < je; jr += NR) {
+                    size_t cols = std::min(NR, nc - jr);
+                    for (size_t ir = 0; ir < mc; ir += MR) {
+                        size_t rows = std::min(MR, mc - ir);
+                        Kernel::Run(kc, pa.get() + ir * kc, pb.get() + jr * kc, out);
+                        _Td *dst = c + (ic + ir) * n + jc + jr;
+                        for (size_t r = 0; r < rows; ++r) {
+                            for (size_t q = 0; q < cols; ++q) {
+                                dst[r * n + q] = ElementOp<_Sub ? '-' : '+'>::Apply(dst[r * n + q], out[r * NR + q]);
+                            }
+                        }
+                    }
+                }
+            }, threads);
         }
     }
-    return result;
 }
 
+template<bool _Sub, typename _Td>
+void Gemm(const size_t &m, const size_t &n, const size_t &p, const _Td *a, const _Td *b, _Td *c)
+{
+    GemmPacked<_Sub>(m, n, p, a, b, c, std::is_arithmetic<_Td>());
+}
+
+/**
+ * dst (cols x rows) = transpose of src (rows x cols), a tile at a time so that
+ * neither side is walked down a column across the whole matrix.
+ */
 template<typename _Td>
-Matrix<_Td> operator-(Matrix<_Td> &&mat)
+void TransposeTo(const _Td *src, const size_t &rows, const size_t &cols, _Td *dst)
 {
-    for (size_t i = 0; i < mat.RowSize(); ++i) {
-        for (size_t j = 0; j < mat.ColSize(); ++j) {
-            mat[i][j] = -mat[i][j];
+    for (size_t ib = 0; ib < rows; ib += TRANSPOSE_BLOCK) {
+        size_t ie = std::min(rows, ib + TRANSPOSE_BLOCK);
+        for (size_t jb = 0; jb < cols; jb += TRANSPOSE_BLOCK) {
+            size_t je = std::min(cols, jb + TRANSPOSE_BLOCK);
+            for (size_t i = ib; i < ie; ++i) {
+                for (size_t j = jb; j < je; ++j) {
+                    dst[j * rows + i] = src[i * cols + j];
+                }
+            }
         }
     }
+}
+
+}
+
+namespace __detail {
+
+/**
+ * What an expression keeps of an operand passed as _A &&: a named matrix by reference;
+ * a temporary matrix and any other expression, which is small unless it owns one,
+ * by value, moved in when it is a temporary.
+ */
+template<typename _A>
+struct ExprHold {
+    typedef typename std::remove_cv<typename std::remove_reference<_A>::type>::type type;
+};
+
+template<typename _Td>
+struct ExprHold<Matrix<_Td> &> {
+    typedef const Matrix<_Td> &type;
+};
+
+template<typename _Td>
+struct ExprHold<const Matrix<_Td> &> {
+    typedef const Matrix<_Td> &type;
+};
+
+// The element type of expression _A; no match, so no operator, for anything else.
+template<typename _E, typename _Td>
+_Td ExprElement(const MatrixExpr<_E, _Td> *);
+
+template<typename _A>
+using ExprElementOf = decltype(ExprElement(static_cast<typename std::decay<_A>::type *>(nullptr)));
+
+template<typename _A, typename _B>
+using SameElement = typename std::enable_if<std::is_same<ExprElementOf<_A>, ExprElementOf<_B>>::value>::type;
+
+// A matrix is used as it is, an expression is evaluated into tmp first.
+template<typename _Td>
+const Matrix<_Td> & Materialize(const Matrix<_Td> &mat, Matrix<_Td> &)
+{
     return mat;
 }
 
+template<typename _Expr, typename _Td>
+const Matrix<_Td> & Materialize(const MatrixExpr<_Expr, _Td> &expr, Matrix<_Td> &tmp)
+{
+    tmp = expr;
+    return tmp;
+}
+
 /**
- * Multiplication of two matrics.
+ * StoreTo and AddTo of the element-by-element expressions: one pass over dst through At().
+ */
+template<typename _Expr, typename _Td>
+class MapExpr : public MatrixExpr<_Expr, _Td> {
+public:
+    void StoreEach(_Td *dst) const
+    {
+        const _Expr &e = this->Self();
+        e.Prepare();
+        const size_t size = e.RowSize() * e.ColSize();
+        for (size_t i = 0; i < size; ++i) {
+            dst[i] = e.At(i);
+        }
+    }
+    void AddEach(_Td *dst, const bool &minus) const
+    {
+        const _Expr &e = this->Self();
+        e.Prepare();
+        const size_t size = e.RowSize() * e.ColSize();
+        if (minus) {
+            for (size_t i = 0; i < size; ++i) {
+                dst[i] = dst[i] - e.At(i);
+            }
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                dst[i] = dst[i] + e.At(i);
+            }
+        }
+    }
+};
+
+/**
+ * l + r, or l - r if _Minus. Without products inside it is a single pass;
+ * otherwise each side goes into dst in turn, so products accumulate in place.
+ */
+template<typename _L, typename _R, typename _Td, bool _Minus>
+class MatrixSum : public MapExpr<MatrixSum<_L, _R, _Td, _Minus>, _Td> {
+    _L l;
+    _R r;
+public:
+    static const bool ELEMENTWISE = std::decay<_L>::type::ELEMENTWISE && std::decay<_R>::type::ELEMENTWISE;
+    template<typename _A, typename _B>
+    MatrixSum(_A &&_l, _B &&_r) : l(std::forward<_A>(_l)), r(std::forward<_B>(_r)) {}
+    size_t RowSize() const
+    {
+        return l.RowSize();
+    }
+    size_t ColSize() const
+    {
+        return l.ColSize();
+    }
+    _Td At(const size_t &idx) const
+    {
+        return ElementOp<_Minus ? '-' : '+'>::Apply(l.At(idx), r.At(idx));
+    }
+    void Prepare() const
+    {
+        l.Prepare();
+        r.Prepare();
+    }
+    void StoreTo(_Td *dst) const
+    {
+        if (ELEMENTWISE) {
+            this->StoreEach(dst);
+        } else {
+            l.StoreTo(dst);
+            r.AddTo(dst, _Minus);
+        }
+    }
+    void AddTo(_Td *dst, const bool &minus) const
+    {
+        if (ELEMENTWISE) {
+            this->AddEach(dst, minus);
+        } else {
+            l.AddTo(dst, minus);
+            r.AddTo(dst, minus != _Minus);
+        }
+    }
+    bool Reads(const _Td *p) const
+    {
+        return l.Reads(p) || r.Reads(p);
+    }
+};
+
+/**
+ * e * s, e / s or -e for _Op '*', '/' and 'n'.
+ */
+template<typename _E, typename _Td, typename _S, char _Op>
+class MatrixMap : public MapExpr<MatrixMap<_E, _Td, _S, _Op>, _Td> {
+    _E e;
+    _S s;
+public:
+    static const bool ELEMENTWISE = std::decay<_E>::type::ELEMENTWISE;
+    template<typename _A>
+    MatrixMap(_A &&_e, const _S &_s) : e(std::forward<_A>(_e)), s(_s) {}
+    size_t RowSize() const
+    {
+        return e.RowSize();
+    }
+    size_t ColSize() const
+    {
+        return e.ColSize();
+    }
+    _Td At(const size_t &idx) const
+    {
+        return ElementOp<_Op>::Apply(e.At(idx), s);
+    }
+    void Prepare() const
+    {
+        e.Prepare();
+    }
+    void StoreTo(_Td *dst) const
+    {
+        this->StoreEach(dst);
+    }
+    void AddTo(_Td *dst, const bool &minus) const
+    {
+        this->AddEach(dst, minus);
+    }
+    bool Reads(const _Td *p) const
+    {
+        return e.Reads(p);
+    }
+};
+
+/**
+ * l * r. StoreTo and AddTo run the multiply straight into dst; only At(),
+ * for a product under a scale or a negation, needs it evaluated on its own.
  */
+template<typename _L, typename _R, typename _Td>
+class MatrixProduct : public MatrixExpr<MatrixProduct<_L, _R, _Td>, _Td> {
+    _L l;
+    _R r;
+    mutable Matrix<_Td> value;
+    mutable bool ready = false;
+public:
+    static const bool ELEMENTWISE = false;
+    template<typename _A, typename _B>
+    MatrixProduct(_A &&_l, _B &&_r) : l(std::forward<_A>(_l)), r(std::forward<_B>(_r)) {}
+    size_t RowSize() const
+    {
+        return l.RowSize();
+    }
+    size_t ColSize() const
+    {
+        return r.ColSize();
+    }
+    const _Td & At(const size_t &idx) const
+    {
+        return value.Data()[idx];
+    }
+    void Prepare() const
+    {
+        if (!ready) {
+            Matrix<_Td> la, ra;
+            value.AssignProduct(Materialize(l, la), Materialize(r, ra));
+            ready = true;
+        }
+    }
+    void StoreTo(_Td *dst) const
+    {
+        std::fill(dst, dst + RowSize() * ColSize(), _Td(0));
+        AddTo(dst, false);
+    }
+    void AddTo(_Td *dst, const bool &minus) const
+    {
+        if (ready) {
+            value.AddTo(dst, minus);
+            return;
+        }
+        Matrix<_Td> la, ra;
+        const Matrix<_Td> &a = Materialize(l, la), &b = Materialize(r, ra);
+        if (minus) {
+            Gemm<true>(a.RowSize(), b.ColSize(), a.ColSize(), a.Data(), b.Data(), dst);
+        } else {
+            Gemm<false>(a.RowSize(), b.ColSize(), a.ColSize(), a.Data(), b.Data(), dst);
+        }
+    }
+    bool Reads(const _Td *p) const
+    {
+        return l.Reads(p) || r.Reads(p);
+    }
+};
+
+}
+
 template<typename _Td>
-Matrix<_Td> operator*(const Matrix<_Td> &a, const Matrix<_Td> &b)
+template<typename _Expr>
+void Matrix<_Td>::_Assign(const MatrixExpr<_Expr, _Td> &expr)
+{
+    const _Expr &e = expr.Self();
+    // A product writing into this would overwrite what it still has to read.
+    if (!_Expr::ELEMENTWISE && e.Reads(data.data())) {
+        *this = Matrix<_Td>(expr);
+        return;
+    }
+    n_rows = e.RowSize();
+    n_cols = e.ColSize();
+    data.resize(n_rows * n_cols);
+    e.StoreTo(data.data());
+}
+
+template<typename _Td>
+template<typename _Expr>
+void Matrix<_Td>::_Accumulate(const MatrixExpr<_Expr, _Td> &expr, const bool &minus)
+{
+    const _Expr &e = expr.Self();
+    if (e.RowSize() != n_rows || e.ColSize() != n_cols) {
+        throw std::invalid_argument("different matrics\'s sizes");
+    }
+    if (!_Expr::ELEMENTWISE && e.Reads(data.data())) {
+        Matrix<_Td>(expr).AddTo(data.data(), minus);
+        return;
+    }
+    e.AddTo(data.data(), minus);
+}
+
+template<typename _Td>
+template<typename _Expr>
+Matrix<_Td> & Matrix<_Td>::operator*=(const MatrixExpr<_Expr, _Td> &expr)
+{
+    Matrix<_Td> tmp, result;
+    result.AssignProduct(*this, __detail::Materialize(expr.Self(), tmp));
+    return *this = std::move(result);
+}
+
+template<typename _Td>
+void Matrix<_Td>::AssignProduct(const Matrix<_Td> &a, const Matrix<_Td> &b)
 {
     if (a.ColSize() != b.RowSize()) {
         throw std::invalid_argument("different matrics\'s sizes");
     }
-    Matrix<_Td> c(a.RowSize(), b.ColSize(), 0);
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < b.ColSize(); ++j) {
-            for (size_t k = 0; k < a.ColSize(); ++k) {
-                c[i][j] += a[i][k] * b[k][j];
-            }
-        }
+    n_rows = a.RowSize();
+    n_cols = b.ColSize();
+    if (data.size() != n_rows * n_cols) {
+        data.assign(n_rows * n_cols, _Td(0));
+    } else {
+        std::fill(data.begin(), data.end(), _Td(0));
     }
-    return c;
+    __detail::Gemm<false>(n_rows, n_cols, a.ColSize(), a.Data(), b.Data(), data.data());
 }
 
 /**
- * Operations between a number and a matrix;
+ * A square matrix swaps its tiles across the diagonal in place;
+ * any other shape goes through one buffer of the same size.
  */
 template<typename _Td>
-Matrix<_Td> operator*(const Matrix<_Td> &a, const _Td &b)
+void Matrix<_Td>::TransposeInPlace()
 {
-    Matrix<_Td> c(a.RowSize(), a.ColSize());
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < a.ColSize(); ++j) {
-            c[i][j] = a[i][j] * b;
+    if (n_rows != n_cols) {
+        std::vector<_Td> res(data.size());
+        __detail::TransposeTo(data.data(), n_rows, n_cols, res.data());
+        data.swap(res);
+        std::swap(n_rows, n_cols);
+        return;
+    }
+    const size_t n = n_rows, B = __detail::TRANSPOSE_BLOCK;
+    _Td *d = data.data();
+    for (size_t ib = 0; ib < n; ib += B) {
+        size_t ie = std::min(n, ib + B);
+        for (size_t i = ib; i < ie; ++i) {
+            for (size_t j = i + 1; j < ie; ++j) {
+                std::swap(d[i * n + j], d[j * n + i]);
+            }
+        }
+        for (size_t jb = ib + B; jb < n; jb += B) {
+            size_t je = std::min(n, jb + B);
+            for (size_t i = ib; i < ie; ++i) {
+                for (size_t j = jb; j < je; ++j) {
+                    std::swap(d[i * n + j], d[j * n + i]);
+                }
+            }
         }
     }
-    return c;
 }
 
-template<typename _Td>
-Matrix<_Td> operator*(const _Td &b, const Matrix<_Td> &a)
+/**
+ * Sum of two matrics.
+ */
+template<typename _A, typename _B, typename = __detail::SameElement<_A, _B>>
+__detail::MatrixSum<typename __detail::ExprHold<_A>::type, typename __detail::ExprHold<_B>::type,
+                    __detail::ExprElementOf<_A>, false>
+operator+(_A &&a, _B &&b)
 {
-    Matrix<_Td> c(a.RowSize(), a.ColSize());
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < a.ColSize(); ++j) {
-            c[i][j] = a[i][j] * b;
-        }
+    if (a.RowSize() != b.RowSize() || a.ColSize() != b.ColSize()) {
+        throw std::invalid_argument("different matrics\'s sizes");
     }
-    return c;
+    return __detail::MatrixSum<typename __detail::ExprHold<_A>::type, typename __detail::ExprHold<_B>::type,
+                               __detail::ExprElementOf<_A>, false>(std::forward<_A>(a), std::forward<_B>(b));
+}
+
+template<typename _A, typename _B, typename = __detail::SameElement<_A, _B>>
+__detail::MatrixSum<typename __detail::ExprHold<_A>::type, typename __detail::ExprHold<_B>::type,
+                    __detail::ExprElementOf<_A>, true>
+operator-(_A &&a, _B &&b)
+{
+    if (a.RowSize() != b.RowSize() || a.ColSize() != b.ColSize()) {
+        throw std::invalid_argument("different matrics\'s sizes");
+    }
+    return __detail::MatrixSum<typename __detail::ExprHold<_A>::type, typename __detail::ExprHold<_B>::type,
+                               __detail::ExprElementOf<_A>, true>(std::forward<_A>(a), std::forward<_B>(b));
+}
+
+template<typename _L, typename _R, typename _Td>
+bool operator==(const MatrixExpr<_L, _Td> &a, const MatrixExpr<_R, _Td> &b)
+{
+    if (a.RowSize() != b.RowSize() || a.ColSize() != b.ColSize()) {
+        return false;
+    }
+    Matrix<_Td> la, rb;
+    const Matrix<_Td> &x = __detail::Materialize(a.Self(), la), &y = __detail::Materialize(b.Self(), rb);
+    return std::equal(x.Data(), x.Data() + x.RowSize() * x.ColSize(), y.Data());
+}
+
+template<typename _E, typename _Td = __detail::ExprElementOf<_E>>
+__detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, _Td, 'n'> operator-(_E &&mat)
+{
+    return __detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, _Td, 'n'>(std::forward<_E>(mat), _Td());
 }
 
 template<typename _Td>
-Matrix<_Td> operator/(const Matrix<_Td> &a, const double &b)
+Matrix<_Td> operator-(Matrix<_Td> &&mat)
 {
-    Matrix<_Td> c(a.RowSize(), a.ColSize());
-    for (size_t i = 0; i < a.RowSize(); ++i) {
-        for (size_t j = 0; j < a.ColSize(); ++j) {
-            c[i][j] = a[i][j] / b;
-        }
+    const size_t size = mat.RowSize() * mat.ColSize();
+    _Td *p = mat.Data();
+    for (size_t i = 0; i < size; ++i) {
+        p[i] = -p[i];
     }
-    return c;
+    return std::move(mat);
+}
+
+/**
+ * Multiplication of two matrics.
+ */
+template<typename _A, typename _B, typename = __detail::SameElement<_A, _B>>
+__detail::MatrixProduct<typename __detail::ExprHold<_A>::type, typename __detail::ExprHold<_B>::type,
+                        __detail::ExprElementOf<_A>>
+operator*(_A &&a, _B &&b)
+{
+    if (a.ColSize() != b.RowSize()) {
+        throw std::invalid_argument("different matrics\'s sizes");
+    }
+    return __detail::MatrixProduct<typename __detail::ExprHold<_A>::type, typename __detail::ExprHold<_B>::type,
+                                   __detail::ExprElementOf<_A>>(std::forward<_A>(a), std::forward<_B>(b));
+}
+
+/**
+ * Operations between a number and a matrix;
+ */
+template<typename _E, typename _Td = __detail::ExprElementOf<_E>>
+__detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, _Td, '*'>
+operator*(_E &&a, const typename std::enable_if<true, _Td>::type &b)
+{
+    return __detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, _Td, '*'>(std::forward<_E>(a), b);
+}
+
+template<typename _E, typename _Td = __detail::ExprElementOf<_E>>
+__detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, _Td, '*'>
+operator*(const typename std::enable_if<true, _Td>::type &b, _E &&a)
+{
+    return __detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, _Td, '*'>(std::forward<_E>(a), b);
+}
+
+template<typename _E, typename _Td = __detail::ExprElementOf<_E>>
+__detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, double, '/'> operator/(_E &&a, const double &b)
+{
+    return __detail::MatrixMap<typename __detail::ExprHold<_E>::type, _Td, double, '/'>(std::forward<_E>(a), b);
 }
 
 template<typename _Td>
 Matrix<_Td> Transpose(const Matrix<_Td> &a)
 {
     Matrix<_Td> res(a.ColSize(), a.RowSize());
-    for (size_t i = 0; i < a.ColSize(); ++i) {
-        for (size_t j = 0; j < a.RowSize(); ++j) {
-            res[i][j] = a[j][i];
-        }
-    }
+    __detail::TransposeTo(a.Data(), a.RowSize(), a.ColSize(), res.Data());
     return res;
 }
 
 template<typename _Td>
-std::ostream & operator<<(std::ostream &stream, const Matrix<_Td> &mat)
+Matrix<_Td> Transpose(Matrix<_Td> &&a)
+{
+    a.TransposeInPlace();
+    return std::move(a);
+}
+
+template<typename _E, typename _Td>
+Matrix<_Td> Transpose(const MatrixExpr<_E, _Td> &a)
+{
+    return Transpose(Matrix<_Td>(a));
+}
+
+template<typename _E, typename _Td>
+std::ostream & operator<<(std::ostream &stream, const MatrixExpr<_E, _Td> &expr)
 {
+    Matrix<_Td> tmp;
+    const Matrix<_Td> &mat = __detail::Materialize(expr.Self(), tmp);
     std::ostream::fmtflags oldFlags = stream.flags();
     stream.precision(8);
     stream.setf(std::ios::fixed | std::ios::right);
@@ -235,6 +1180,20 @@ std::ostream & operator<<(std::ostream &stream, const Matrix<_Td> &mat)
     return stream;
 }
 
+/**
+ * How many threads large products and Pow use. 0, the default, means one per hardware
+ * thread; 1 keeps everything on the calling thread.
+ */
+inline void SetThreads(const size_t &threads)
+{
+    __detail::ThreadSetting() = threads;
+}
+
+inline size_t Threads()
+{
+    return __detail::ThreadCount();
+}
+
 template<typename _Td>
 Matrix<_Td> I(const size_t &n)
 {
@@ -245,22 +1204,54 @@ Matrix<_Td> I(const size_t &n)
     return res;
 }
 
+/**
+ * A^b by squaring. Products go into scratch matrices that are swapped with the
+ * result or with A, so after the first step nothing is allocated.
+ * result * A and A * A only read A, so when a product is too small to be split
+ * over the threads on its own the two of a step run side by side instead.
+ */
 template<typename _Td>
 Matrix<_Td> Pow(Matrix<_Td> A, size_t &b)
 {
     if (A.RowSize() != A.ColSize()) {
         throw std::invalid_argument("The row size and column size are different.");
     }
-    Matrix<_Td> result = I<_Td>(A.ColSize());
+    const size_t n = A.RowSize();
+    const bool overlap = Threads() > 1 && !__detail::GemmParallel<_Td>(n, n, n)
+                         && n * n * n >= (std::is_arithmetic<_Td>::value ? __detail::GEMM_SMALL : 1);
+    Matrix<_Td> result = I<_Td>(n), scratch, square;
     while (b > 0) {
-        if (b & static_cast<size_t>(1)) {
-            result = result * A;
-        }
-        A = A * A;
+        bool odd = b & static_cast<size_t>(1);
         b = b >> static_cast<size_t>(1);
+        if (odd && b > 0 && overlap) {
+            __detail::ThreadPool::Instance().Run(2, [&](size_t t) {
+                if (t == 0) {
+                    scratch.AssignProduct(result, A);
+                } else {
+                    square.AssignProduct(A, A);
+                }
+            }, 2);
+            std::swap(result, scratch);
+            std::swap(A, square);
+            continue;
+        }
+        if (odd) {
+            scratch.AssignProduct(result, A);
+            std::swap(result, scratch);
+        }
+        if (b > 0) {
+            scratch.AssignProduct(A, A);
+            std::swap(A, scratch);
+        }
     }
     return result;
 }
 
+template<typename _E, typename _Td>
+Matrix<_Td> Pow(const MatrixExpr<_E, _Td> &A, size_t &b)
+{
+    return Pow(Matrix<_Td>(A), b);
+}
+
 }
 #endif
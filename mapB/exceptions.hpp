@@ -2,38 +2,70 @@
 #define SJTU_EXCEPTIONS_HPP
 
 #include <cstddef>
-#include <cstring>
-#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+
+/*
+ * The messages are string literals, so building, copying or catching
+ * an exception never allocates.
+ *
+ * Containers report errors with SJTU_THROW. When exceptions are turned off
+ * (-fno-exceptions) or __SJTU_NO_EXCEPTIONS__ is defined, it prints what()
+ * to stderr and aborts instead of throwing.
+ */
+#if !defined(__SJTU_NO_EXCEPTIONS__) && !defined(__cpp_exceptions) && !defined(__EXCEPTIONS)
+#define __SJTU_NO_EXCEPTIONS__
+#endif
+
+#ifdef __SJTU_NO_EXCEPTIONS__
+#define SJTU_THROW(error) ::sjtu::__fail(error)
+#else
+#define SJTU_THROW(error) throw error
+#endif
 
 namespace sjtu {
 
-class exception {
+class exception : public std::exception {
 protected:
-    const std::string variant = "";
-    std::string detail = "";
+    const char *message;
 public:
-    exception() {}
-    exception(const exception &ec) : variant(ec.variant), detail(ec.detail) {}
-    virtual std::string what() {
-        return variant + " " + detail;
+    exception() noexcept : message("exception") {}
+    explicit exception(const char *_message) noexcept : message(_message) {}
+    exception(const exception &ec) noexcept : std::exception(ec), message(ec.message) {}
+    exception & operator=(const exception &ec) noexcept {
+        message = ec.message;
+        return *this;
+    }
+    const char * what() const noexcept override {
+        return message;
     }
 };
 
 class index_out_of_bound : public exception {
-    /* __________________________ */
+public:
+    index_out_of_bound() noexcept : exception("index_out_of_bound") {}
 };
 
 class runtime_error : public exception {
-    /* __________________________ */
+public:
+    runtime_error() noexcept : exception("runtime_error") {}
 };
 
 class invalid_iterator : public exception {
-    /* __________________________ */
+public:
+    invalid_iterator() noexcept : exception("invalid_iterator") {}
 };
 
 class container_is_empty : public exception {
-    /* __________________________ */
+public:
+    container_is_empty() noexcept : exception("container_is_empty") {}
 };
+
+[[noreturn]] inline void __fail(const exception &error) noexcept {
+    std::fprintf(stderr, "sjtu::%s\n", error.what());
+    std::abort();
+}
 }
 
 #endif
@@ -10,6 +10,7 @@
 #include <cstddef>
 #include <functional>
 #include <iostream>
+#include <utility>
 
 #include <cmath>
 using std::max;
@@ -45,7 +46,74 @@ public:
         return;
     }
 
+#ifdef __SJTU_STATS__
+    //What this map has cost so far; kept per instance, copies start from zero.
+    struct statistics {
+        size_t allocations, deallocations;
+        size_t bytes_allocated, bytes_freed;
+        size_t rotations;
+        //__query_trav_: nodes visited over all lookups, and the most in one.
+        size_t lookups, depth_total, depth_max;
+    };
+    //called on every counted event with its value (bytes, subtree size, depth), if set.
+    typedef void (*trace_hook)(const void* who, const char* event, size_t value, void* arg);
+
+    statistics stats() const { return __stats; }
+    void reset_stats() { __stats = statistics(); }
+    void set_trace(trace_hook hook, void* arg = nullptr) {
+        __hook     = hook;
+        __hook_arg = arg;
+    }
+
+private:
+    //declared ahead of __end, which is allocated in the initializer lists.
+    mutable statistics __stats = statistics();
+    trace_hook __hook          = nullptr;
+    void* __hook_arg           = nullptr;
+
+    void __trace(const char* event, size_t value) const {
+        if (__hook != nullptr)
+            __hook(this, event, value, __hook_arg);
+    }
+#endif
+
 private:
+    //* Instrumentation: empty unless __SJTU_STATS__ is defined.
+    inline void __note_rotate(node* root) {
+#ifdef __SJTU_STATS__
+        ++__stats.rotations;
+        __trace("rotate", root->size);
+#endif
+    }
+    inline void __note_lookup(size_t depth) const {
+#ifdef __SJTU_STATS__
+        ++__stats.lookups;
+        __stats.depth_total += depth;
+        if (depth > __stats.depth_max)
+            __stats.depth_max = depth;
+        __trace("lookup", depth);
+#endif
+    }
+    //a node with data is two allocations, the node and its value.
+    node* __new_node(const value_type* d = nullptr, int height = 1, int size = 1) {
+#ifdef __SJTU_STATS__
+        size_t bytes = sizeof(node) + (d != nullptr ? sizeof(value_type) : 0);
+        __stats.allocations += d != nullptr ? 2 : 1;
+        __stats.bytes_allocated += bytes;
+        __trace("alloc", bytes);
+#endif
+        return new node(d, height, size);
+    }
+    void __delete_node(node* p) {
+#ifdef __SJTU_STATS__
+        size_t bytes = sizeof(node) + (p->data != nullptr ? sizeof(value_type) : 0);
+        __stats.deallocations += p->data != nullptr ? 2 : 1;
+        __stats.bytes_freed += bytes;
+        __trace("free", bytes);
+#endif
+        delete p;
+    }
+
     //AVL part
     node* __root;
     node* __begin;
@@ -76,6 +144,7 @@ private:
         __set_root_height(nl);
         __set_root_size(nl);
         root = nl;
+        __note_rotate(root);
         return root;
     }
     node* __left_rotate(node*& root) {
@@ -87,6 +156,7 @@ private:
         __set_root_height(nr);
         __set_root_size(nr);
         root = nr;
+        __note_rotate(root);
         return root;
     }
     //Supplimentary
@@ -99,21 +169,26 @@ private:
         __left_rotate(t);
     }
     //find the specific storage node with Key to_query
-    node* __query_trav_(const Key& to_query, node* root) const {
-        if (root == nullptr)
+    //depth: nodes visited so far, counting root.
+    node* __query_trav_(const Key& to_query, node* root, size_t depth = 1) const {
+        if (root == nullptr) {
+            __note_lookup(depth - 1);
             return nullptr;
+        }
         //*** that "fuck you" hit me hard
         if (Compare()(root->data->first, to_query))
-            return __query_trav_(to_query, root->right);
+            return __query_trav_(to_query, root->right, depth + 1);
         else if (Compare()(to_query, root->data->first))
-            return __query_trav_(to_query, root->left);
-        else
+            return __query_trav_(to_query, root->left, depth + 1);
+        else {
+            __note_lookup(depth);
             return root;
+        }
     }
     node* __add_entry(const value_type& value, node*& t) {
         node* tmp;
         if (t == nullptr) {
-            t = new node(&value);
+            t = __new_node(&value);
             return t;
         } else {
             if (Compare()(value.first, t->data->first)) {
@@ -161,6 +236,17 @@ private:
             }
         }
     }
+    //adds value, whose key is known to be missing, and returns its node.
+    node* __insert_absent(const value_type& value) {
+        node* p = __add_entry(value, __root);
+        if (__isleaf(__root)) {
+            //reconnect
+            __root->next = __end;
+            __end->prev  = __root;
+            __begin      = __root;
+        }
+        return p;
+    }
     void __delete_entry(node* obj, node*& t) {
         if (t == nullptr)
             return;
@@ -224,12 +310,12 @@ private:
                         t->next->prev = t->prev;
                     }
                     if (t->left == nullptr && t->right == nullptr) {
-                        delete todel;
+                        __delete_node(todel);
                         t = nullptr;
                         return;
                     }
                     t = t->left != nullptr ? t->left : t->right;
-                    delete todel;
+                    __delete_node(todel);
                 }
             }
         }
@@ -242,11 +328,11 @@ private:
     //traverse when copying
     void ___ctor_inorder_traverse(node* mathis, node* other) {
         if (other->left != nullptr) {
-            mathis->left = new node(other->left->data, other->left->height, other->left->size);
+            mathis->left = __new_node(other->left->data, other->left->height, other->left->size);
             ___ctor_inorder_traverse(mathis->left, other->left);
         }
         if (other->right != nullptr) {
-            mathis->right = new node(other->right->data, other->right->height, other->right->size);
+            mathis->right = __new_node(other->right->data, other->right->height, other->right->size);
             ___ctor_inorder_traverse(mathis->right, other->right);
         }
     }
@@ -262,13 +348,25 @@ private:
         if (nothis->right != nullptr)
             ___ctor_connect_all(nothis->right, npass);
     }
+    //copy other into this empty map.
+    void __copy_from(const map& other) {
+        if (other.__root == nullptr)
+            return;
+        __root = __new_node(other.__root->data, other.__root->height, other.__root->size);
+        ___ctor_inorder_traverse(__root, other.__root);
+        node* proc = nullptr;
+        //Connect all nodes with prev-next
+        ___ctor_connect_all(__root, proc);
+        proc->next  = __end;
+        __end->prev = proc;
+    }
     //traverse to clear
     int ___dtor_postorder_traverse(node* root) {
         if (root == nullptr)
             return 0;
         ___dtor_postorder_traverse(root->left);
         ___dtor_postorder_traverse(root->right);
-        delete root;
+        __delete_node(root);
         return 0;
     }
 
@@ -304,7 +402,7 @@ public:
         }
         iterator& operator++() {
             if (cur_node == nullptr || cur_node->next == nullptr)
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             cur_node = cur_node->next;
             return *this;
         }
@@ -315,7 +413,7 @@ public:
         }
         iterator& operator--() {
             if (cur_node == nullptr || cur_node->prev == nullptr)
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             cur_node = cur_node->prev;
             return *this;
         }
@@ -355,7 +453,7 @@ public:
         }
         const_iterator& operator++() {
             if (cur_node == nullptr || cur_node->next == nullptr)
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             cur_node = cur_node->next;
             return *this;
         }
@@ -366,7 +464,7 @@ public:
         }
         const_iterator& operator--() {
             if (cur_node == nullptr || cur_node->prev == nullptr)
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             cur_node = cur_node->prev;
             return *this;
         }
@@ -378,49 +476,38 @@ public:
         const value_type* operator->() const noexcept { return cur_node->data; }
     };
 
-    map() : __root(nullptr), __end(new node()) { __begin = __end; }
-    map(const map& other) {
-        if (other.__root == nullptr) {
-            __end   = new node;
-            __begin = __end;
-            __root  = nullptr;
-            return;
-        }
-        __root = new node(other.__root->data, other.__root->height, other.__root->size);
-        __end  = new node();
-        ___ctor_inorder_traverse(__root, other.__root);
-        node* proc = nullptr;
-        //Connect all nodes with prev-next
-        ___ctor_connect_all(__root, proc);
-        proc->next  = __end;
-        __end->prev = proc;
+    map() : __root(nullptr), __end(__new_node()) { __begin = __end; }
+    map(const map& other) : __root(nullptr), __end(__new_node()) {
+        __begin = __end;
+        __copy_from(other);
     }
 
+    //clear() then copy, so that this map keeps its own counters and hook.
     map& operator=(const map& other) {
         if (this == &other)
             return *this;
-        this->~map();
-        new (this) map(other);
+        clear();
+        __copy_from(other);
         return *this;
     }
 
     ~map() {
         clear();
         if (__end != nullptr)
-            delete __end;
+            __delete_node(__end);
     }
     //I'm blind. I didn't read the requirements.
     T& at(const Key& key) {
         node* p = __query_trav_(key, __root);
         if (p == nullptr)
-            throw index_out_of_bound();
+            SJTU_THROW(index_out_of_bound());
         return p->data->second;
     }
 
     const T at(const Key& key) const {
         node* p = __query_trav_(key, __root);
         if (p == nullptr)
-            throw index_out_of_bound();
+            SJTU_THROW(index_out_of_bound());
         return p->data->second;
     }
 
@@ -435,7 +522,7 @@ public:
     const T& operator[](const Key& key) const {
         node* p = __query_trav_(key, __root);
         if (p == nullptr) {
-            throw index_out_of_bound();
+            SJTU_THROW(index_out_of_bound());
         }
         return p->data->second;
     }
@@ -452,8 +539,8 @@ public:
     void clear() {
         ___dtor_postorder_traverse(__root);
         //! reinitialize the end ptr;
-        delete __end;
-        __end   = new node;
+        __delete_node(__end);
+        __end   = __new_node();
         __begin = __end;
         __root  = nullptr;
     }
@@ -462,26 +549,53 @@ public:
         node* p = __query_trav_(value.first, __root);
         if (p != nullptr)
             return pair<iterator, bool>(iterator(p, this), false);
-        p = __add_entry(value, __root);
-        if (__isleaf(__root)) {
-            //reconnect
-            __root->next = __end;
-            __end->prev  = __root;
-            __begin      = __root;
-        }
         //Seems that the checker don't care the exception type.
-        return pair<iterator, bool>(iterator(p, this), true);
+        return pair<iterator, bool>(iterator(__insert_absent(value), this), true);
+    }
+
+    //like insert, but T is only built from args when key is missing.
+    template <class... Args>
+    pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+        node* p = __query_trav_(key, __root);
+        if (p != nullptr)
+            return pair<iterator, bool>(iterator(p, this), false);
+        return pair<iterator, bool>(iterator(__insert_absent(value_type(key, T(std::forward<Args>(args)...))), this), true);
+    }
+
+    //assigns obj to the value of key if it is there, inserts it otherwise; true if inserted.
+    pair<iterator, bool> insert_or_assign(const Key& key, const T& obj) {
+        node* p = __query_trav_(key, __root);
+        if (p != nullptr) {
+            p->data->second = obj;
+            return pair<iterator, bool>(iterator(p, this), false);
+        }
+        return pair<iterator, bool>(iterator(__insert_absent(value_type(key, obj)), this), true);
     }
 
     void erase(iterator pos) {
         if (pos.mathis != this || pos.cur_node == nullptr || pos.cur_node->data == nullptr)
-            throw invalid_iterator();
+            SJTU_THROW(invalid_iterator());
         //Seems that the checker don't care the exception type.
         __delete_entry(pos.cur_node, __root);
     }
 
     size_t count(const Key& key) const { return __query_trav_(key, __root) != nullptr; }
 
+    //one descent, no exception: the value of key, or nullptr if it is missing.
+    T* try_get(const Key& key) {
+        node* p = __query_trav_(key, __root);
+        return p == nullptr ? nullptr : &p->data->second;
+    }
+    const T* try_get(const Key& key) const {
+        node* p = __query_trav_(key, __root);
+        return p == nullptr ? nullptr : &p->data->second;
+    }
+    //the value of key, or fallback if it is missing.
+    T get_or(const Key& key, const T& fallback) const {
+        node* p = __query_trav_(key, __root);
+        return p == nullptr ? fallback : p->data->second;
+    }
+
     iterator find(const Key& key) {
         node* p = __query_trav_(key, __root);
         return p == nullptr ? end() : iterator(p, this);
@@ -0,0 +1,304 @@
+#include "memtrack.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <dlfcn.h>
+#include <link.h>
+#include <unistd.h>
+#if __has_include(<sys/single_threaded.h>)
+#include <sys/single_threaded.h>
+#define __MEMTRACK_SINGLE__ __libc_single_threaded
+#else
+#define __MEMTRACK_SINGLE__ false
+#endif
+
+//  Allocation tracker: replaces the global operator new / delete (every form), so linking this file
+//  next to any driver tracks everything it allocates through new, sjtu containers included.
+//
+//    g++ -O2 -std=c++14 code.cpp ../../../memtrack/memtrack.cpp -o code -ldl
+//
+//  At exit it prints to stderr: totals, peak live bytes, the call sites with the most allocations,
+//  and every call site that still has live blocks (leaks). A call site is the return address of
+//  operator new, named by addr2line when it is around; build with -g for file:line.
+//  The checks valgrind would make on delete are made cheaply: a block that did not come from new,
+//  or was deleted already, and a sized delete with the wrong size are reported as errors.
+//
+//  environment  MEMTRACK_TOP=n     call sites listed (default 10)
+//               MEMTRACK_RAW=1     addresses only, do not run addr2line
+//               MEMTRACK_STRICT=1  exit with 1 when anything leaked or went wrong
+//
+//  Each block carries a 16 byte header in front of it (its size and call site), the counters
+//  are relaxed atomics in a fixed table (plain adds while there is only one thread), nothing here
+//  allocates through new.
+
+namespace {
+
+//a block is [header][user bytes], the header right before the pointer handed out.
+struct header {
+    size_t size;
+    uint32_t site;
+    uint32_t magic;
+};
+const uint32_t LIVE        = 0x6d656d74;
+const size_t HEADER        = 16;
+const size_t DEFAULT_ALIGN = 16;
+
+//call sites, open addressing on the return address; slot 0 takes whatever does not fit.
+const size_t SITES = 1 << 14;
+struct site {
+    std::atomic<uintptr_t> addr;
+    std::atomic<size_t> allocs, bytes;
+    std::atomic<size_t> live_blocks, live_bytes;
+};
+site sites[SITES];
+
+std::atomic<size_t> live_bytes, peak_bytes;
+std::atomic<size_t> errors;
+
+//a locked add costs as much as the rest of new, skip it until a second thread exists.
+inline void __add(std::atomic<size_t>& a, size_t n) {
+    if (__MEMTRACK_SINGLE__)
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    else
+        a.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint32_t __site_of(void* caller) {
+    uintptr_t addr = (uintptr_t)caller;
+    size_t h       = (addr >> 4) * 0x9e3779b97f4a7c15ull >> 50;
+    for (size_t i = 0; i < SITES; i++) {
+        size_t at = (h + i) & (SITES - 1);
+        if (at == 0)
+            continue;
+        uintptr_t seen = sites[at].addr.load(std::memory_order_acquire);
+        if (seen == addr)
+            return at;
+        if (seen == 0 && sites[at].addr.compare_exchange_strong(seen, addr, std::memory_order_acq_rel))
+            return at;
+        if (seen == addr)
+            return at;
+    }
+    return 0;
+}
+
+void* __record(void* base, size_t n, size_t align, void* caller) {
+    char* user = (char*)base + align;
+    header* h  = (header*)(user - HEADER);
+    h->size    = n;
+    h->site    = __site_of(caller);
+    h->magic   = LIVE;
+
+    site& s = sites[h->site];
+    __add(s.allocs, 1);
+    __add(s.bytes, n);
+    __add(s.live_blocks, 1);
+    __add(s.live_bytes, n);
+    __add(live_bytes, n);
+    size_t now  = live_bytes.load(std::memory_order_relaxed);
+    size_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while (now > peak && !peak_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+        ;
+    return user;
+}
+
+//the usual new: retry through the new_handler, throw if there is none.
+void* __allocate(size_t n, size_t align, void* caller, bool nothrow) {
+    for (;;) {
+        void* base;
+        if (align <= DEFAULT_ALIGN)
+            base = malloc(n + HEADER);
+        else
+            base = aligned_alloc(align, (n + align + align - 1) / align * align);
+        if (base != nullptr)
+            return __record(base, n, align <= DEFAULT_ALIGN ? HEADER : align, caller);
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr) {
+            if (nothrow)
+                return nullptr;
+            throw std::bad_alloc();
+        }
+        if (!nothrow) {
+            handler();
+            continue;
+        }
+        try {
+            handler();
+        } catch (...) {
+            return nullptr;
+        }
+    }
+}
+
+void __error(const char* what, void* p, size_t a, size_t b, void* caller) {
+    errors.fetch_add(1, std::memory_order_relaxed);
+    char line[160];
+    int len = snprintf(line, sizeof(line), "memtrack: %s at %p (%zu, %zu) from %p\n", what, p, a, b, caller);
+    if (write(2, line, len) < 0)
+        return;
+}
+
+//sized: the size the caller says it is, or -1.
+void __deallocate(void* p, size_t align, size_t sized, void* caller) {
+    if (p == nullptr)
+        return;
+    header* h = (header*)((char*)p - HEADER);
+    if (h->magic != LIVE) {
+        //freeing it would be worse than leaking it.
+        __error("delete of a block not from new, or deleted twice", p, 0, 0, caller);
+        return;
+    }
+    if (sized != (size_t)-1 && sized != h->size)
+        __error("sized delete with the wrong size (said, was)", p, sized, h->size, caller);
+    site& s = sites[h->site];
+    __add(s.live_blocks, -1);
+    __add(s.live_bytes, -h->size);
+    __add(live_bytes, -h->size);
+    h->magic = 0;
+    free((char*)p - (align <= DEFAULT_ALIGN ? HEADER : align));
+}
+
+size_t __env(const char* name, size_t otherwise) {
+    const char* v = getenv(name);
+    return v == nullptr || *v == 0 ? otherwise : strtoul(v, nullptr, 10);
+}
+
+//what a call site is: "function at file:line" from addr2line, or the module and offset.
+void __describe(uintptr_t addr, char* out, size_t len) {
+    Dl_info info;
+    if (addr == 0) {
+        snprintf(out, len, "(other sites, table full)");
+        return;
+    }
+    if (dladdr((void*)addr, &info) == 0 || info.dli_fname == nullptr) {
+        snprintf(out, len, "%p", (void*)addr);
+        return;
+    }
+    //shared objects and PIE executables are looked up by offset, others by address.
+    uintptr_t at = addr - 1;
+    if (((ElfW(Ehdr)*)info.dli_fbase)->e_type == ET_DYN)
+        at -= (uintptr_t)info.dli_fbase;
+    const char* module = info.dli_fname[0] ? info.dli_fname : "/proc/self/exe";
+    snprintf(out, len, "%s+%#lx", module, (unsigned long)at);
+    if (__env("MEMTRACK_RAW", 0))
+        return;
+    char cmd[4352];
+    snprintf(cmd, sizeof(cmd), "addr2line -f -C -s -e '%s' %#lx 2>/dev/null", module, (unsigned long)at);
+    FILE* pipe = popen(cmd, "r");
+    if (pipe == nullptr)
+        return;
+    char func[512] = "", where[512] = "";
+    if (fgets(func, sizeof(func), pipe) != nullptr && fgets(where, sizeof(where), pipe) != nullptr) {
+        func[strcspn(func, "\n")]   = 0;
+        where[strcspn(where, "\n")] = 0;
+        if (strcmp(func, "??") != 0)
+            snprintf(out, len, "%s at %s", func, where);
+    }
+    pclose(pipe);
+}
+
+void __print_site(FILE* out, size_t i) {
+    char name[1024];
+    __describe(sites[i].addr.load(), name, sizeof(name));
+    fprintf(out, "  %10zu %14zu %8zu %12zu  %s\n", sites[i].allocs.load(), sites[i].bytes.load(),
+            sites[i].live_blocks.load(), sites[i].live_bytes.load(), name);
+}
+
+int __by_allocs(const void* a, const void* b) {
+    size_t x = sites[*(const size_t*)a].allocs.load(), y = sites[*(const size_t*)b].allocs.load();
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+__attribute__((destructor)) void __at_exit() {
+    //runs after the static destructors, so whatever is live now has leaked.
+    memtrack::report(stderr);
+    memtrack::summary s = memtrack::snapshot();
+    if ((s.live_blocks != 0 || errors.load() != 0) && __env("MEMTRACK_STRICT", 0))
+        _exit(1);
+}
+
+} // namespace
+
+namespace memtrack {
+
+summary snapshot() {
+    summary s = summary();
+    for (size_t i = 0; i < SITES; i++) {
+        if (sites[i].allocs.load(std::memory_order_relaxed) == 0)
+            continue;
+        ++s.sites;
+        s.allocations += sites[i].allocs.load(std::memory_order_relaxed);
+        s.bytes_allocated += sites[i].bytes.load(std::memory_order_relaxed);
+        s.live_blocks += sites[i].live_blocks.load(std::memory_order_relaxed);
+    }
+    s.deallocations = s.allocations - s.live_blocks;
+    s.live_bytes    = live_bytes.load();
+    s.peak_bytes    = peak_bytes.load();
+    return s;
+}
+
+void reset_peak() {
+    peak_bytes.store(live_bytes.load());
+}
+
+void report(FILE* out) {
+    summary s = snapshot();
+    fprintf(out, "memtrack: %zu allocations, %zu frees, %zu bytes allocated, peak %zu bytes live, %zu call sites\n",
+            s.allocations, s.deallocations, s.bytes_allocated, s.peak_bytes, s.sites);
+    if (s.sites == 0)
+        return;
+    size_t* order = (size_t*)malloc(sizeof(size_t) * s.sites);
+    size_t n      = 0;
+    for (size_t i = 0; i < SITES && n < s.sites; i++)
+        if (sites[i].allocs.load() != 0)
+            order[n++] = i;
+    qsort(order, n, sizeof(size_t), __by_allocs);
+
+    size_t top = __env("MEMTRACK_TOP", 10);
+    fprintf(out, "memtrack: top call sites by allocations\n  %10s %14s %8s %12s  %s\n", "allocs", "bytes", "live", "live bytes", "site");
+    for (size_t i = 0; i < n && i < top; i++)
+        __print_site(out, order[i]);
+    if (s.live_blocks != 0) {
+        fprintf(out, "memtrack: LEAK %zu blocks, %zu bytes still live\n", s.live_blocks, s.live_bytes);
+        for (size_t i = 0; i < n; i++)
+            if (sites[order[i]].live_blocks.load() != 0)
+                __print_site(out, order[i]);
+    }
+    if (errors.load() != 0)
+        fprintf(out, "memtrack: %zu bad deletes, see above\n", errors.load());
+    free(order);
+    fflush(out);
+}
+
+} // namespace memtrack
+
+//* The replacements. Every form forwards here, so a call site is always the caller of one of these.
+void* operator new(size_t n) { return __allocate(n, DEFAULT_ALIGN, __builtin_return_address(0), false); }
+void* operator new[](size_t n) { return __allocate(n, DEFAULT_ALIGN, __builtin_return_address(0), false); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return __allocate(n, DEFAULT_ALIGN, __builtin_return_address(0), true); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return __allocate(n, DEFAULT_ALIGN, __builtin_return_address(0), true); }
+
+void operator delete(void* p) noexcept { __deallocate(p, DEFAULT_ALIGN, -1, __builtin_return_address(0)); }
+void operator delete[](void* p) noexcept { __deallocate(p, DEFAULT_ALIGN, -1, __builtin_return_address(0)); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { __deallocate(p, DEFAULT_ALIGN, -1, __builtin_return_address(0)); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { __deallocate(p, DEFAULT_ALIGN, -1, __builtin_return_address(0)); }
+void operator delete(void* p, size_t n) noexcept { __deallocate(p, DEFAULT_ALIGN, n, __builtin_return_address(0)); }
+void operator delete[](void* p, size_t n) noexcept { __deallocate(p, DEFAULT_ALIGN, n, __builtin_return_address(0)); }
+
+#ifdef __cpp_aligned_new
+//over-aligned types, C++17 on.
+void* operator new(size_t n, std::align_val_t a) { return __allocate(n, (size_t)a, __builtin_return_address(0), false); }
+void* operator new[](size_t n, std::align_val_t a) { return __allocate(n, (size_t)a, __builtin_return_address(0), false); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return __allocate(n, (size_t)a, __builtin_return_address(0), true); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return __allocate(n, (size_t)a, __builtin_return_address(0), true); }
+
+void operator delete(void* p, std::align_val_t a) noexcept { __deallocate(p, (size_t)a, -1, __builtin_return_address(0)); }
+void operator delete[](void* p, std::align_val_t a) noexcept { __deallocate(p, (size_t)a, -1, __builtin_return_address(0)); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept { __deallocate(p, (size_t)a, -1, __builtin_return_address(0)); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept { __deallocate(p, (size_t)a, -1, __builtin_return_address(0)); }
+void operator delete(void* p, size_t n, std::align_val_t a) noexcept { __deallocate(p, (size_t)a, n, __builtin_return_address(0)); }
+void operator delete[](void* p, size_t n, std::align_val_t a) noexcept { __deallocate(p, (size_t)a, n, __builtin_return_address(0)); }
+#endif
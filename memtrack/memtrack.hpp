@@ -0,0 +1,28 @@
+#ifndef SJTU_MEMTRACK_HPP
+#define SJTU_MEMTRACK_HPP
+
+#include <cstddef>
+#include <cstdio>
+
+//  Queries on the allocation tracker in memtrack.cpp; only needed by a program that wants the
+//  numbers itself, linking memtrack.cpp is enough for the report at exit.
+namespace memtrack {
+
+struct summary {
+    size_t allocations, deallocations;
+    size_t bytes_allocated;
+    //bytes and blocks still allocated now, and the most bytes there have been at once.
+    size_t live_bytes, live_blocks, peak_bytes;
+    //call sites seen so far.
+    size_t sites;
+};
+
+summary snapshot();
+//the most live bytes from now on are counted from the current live bytes.
+void reset_peak();
+//what is printed at exit: totals, the top call sites and everything still live.
+void report(FILE* out);
+
+} // namespace memtrack
+
+#endif
@@ -26,6 +26,61 @@ private:
     //               ^.....serve as the full-vector flag.
     //           ^.........r_size==(5-0):the current end index.
 
+#ifdef __SJTU_STATS__
+public:
+    //What this vector has cost so far; kept per instance, copies start from zero.
+    struct statistics {
+        size_t allocations, deallocations;
+        size_t bytes_allocated, bytes_freed;
+        size_t enlarges, shrinks;
+    };
+    //called on every counted event with the new value (bytes, capacity), if set.
+    typedef void (*trace_hook)(const void* who, const char* event, size_t value, void* arg);
+
+    statistics stats() const { return __stats; }
+    void reset_stats() { __stats = statistics(); }
+    void set_trace(trace_hook hook, void* arg = nullptr) {
+        __hook     = hook;
+        __hook_arg = arg;
+    }
+
+private:
+    //declared ahead of container, which is allocated in the initializer lists.
+    statistics __stats = statistics();
+    trace_hook __hook  = nullptr;
+    void* __hook_arg   = nullptr;
+
+    void __trace(const char* event, size_t value) const {
+        if (__hook != nullptr)
+            __hook(this, event, value, __hook_arg);
+    }
+#endif
+
+    //* Instrumentation: empty unless __SJTU_STATS__ is defined.
+    void __note_resize(bool grow, size_t capacity) {
+#ifdef __SJTU_STATS__
+        ++(grow ? __stats.enlarges : __stats.shrinks);
+        __trace(grow ? "enlarge" : "shrink", capacity);
+#endif
+    }
+    //all storage goes through these two.
+    T* __allocate(size_t n) {
+#ifdef __SJTU_STATS__
+        ++__stats.allocations;
+        __stats.bytes_allocated += sizeof(T) * n;
+        __trace("alloc", sizeof(T) * n);
+#endif
+        return (T*)operator new[](sizeof(T) * n);
+    }
+    void __deallocate(T* p, size_t n) {
+#ifdef __SJTU_STATS__
+        ++__stats.deallocations;
+        __stats.bytes_freed += sizeof(T) * n;
+        __trace("free", sizeof(T) * n);
+#endif
+        operator delete[](p, n * sizeof(T));
+    }
+
     //Distinguished with option works.
     size_t r_capacity;
     // Data Container
@@ -68,7 +123,7 @@ public:
         iterator operator+(const int& n) const {
             // check if bound valid.
             if (delta + n < 0 || delta + n > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             // forbid vector.end() access.
             if (delta + n == v->r_size)
                 return iterator(v, delta + n, false);
@@ -83,13 +138,13 @@ public:
         int operator-(const iterator& rhs) const {
             //different vectors shall throw invaild_iterator.
             if (v != rhs.v)
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             return delta - rhs.delta;
         }
         iterator& operator+=(const int& n) {
             // check if bound valid.
             if (delta + n < 0 || delta + n > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             // forbid vector.end() access, removing limit on others.
             if (delta + n == v->r_size)
                 legal = false;
@@ -107,7 +162,7 @@ public:
         iterator operator++(int) {
             // check if bound valid.
             if (delta + 1 < 0 || delta + 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta + 1 == v->r_size)
@@ -120,7 +175,7 @@ public:
 
         iterator& operator++() {
             if (delta + 1 < 0 || delta + 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta + 1 == v->r_size)
@@ -134,7 +189,7 @@ public:
         iterator operator--(int) {
             // check if bound valid.
             if (delta - 1 < 0 || delta - 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta - 1 == v->r_size)
@@ -147,7 +202,7 @@ public:
 
         iterator& operator--() {
             if (delta - 1 < 0 || delta - 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta - 1 == v->r_size)
@@ -163,7 +218,7 @@ public:
             if (legal)
                 return (*v)[delta];
             else
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
         }
 
         bool operator==(const iterator& rhs) const {
@@ -205,7 +260,7 @@ public:
         const_iterator operator+(const int& n) const {
             // check if bound valid.
             if (delta + n < 0 || delta + n > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             // forbid vector.end() access.
             if (delta + n == v->r_size)
                 return const_iterator(v, delta + n, false);
@@ -218,13 +273,13 @@ public:
 
         int operator-(const const_iterator& rhs) const {
             if (v != rhs.v)
-                throw invalid_iterator();
+                SJTU_THROW(invalid_iterator());
             return delta - rhs.delta;
         }
         const_iterator& operator+=(const int& n) {
             // check if bound valid.
             if (delta + n < 0 || delta + n > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             // forbid vector.end() access, removing limit on others.
             if (delta + n == v->r_size)
                 legal = false;
@@ -241,7 +296,7 @@ public:
         const_iterator operator++(int) {
             // check if bound valid.
             if (delta + 1 < 0 || delta + 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             const_iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta + 1 == v->r_size)
@@ -254,7 +309,7 @@ public:
 
         const_iterator& operator++() {
             if (delta + 1 < 0 || delta + 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             const_iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta + 1 == v->r_size)
@@ -268,7 +323,7 @@ public:
         const_iterator operator--(int) {
             // check if bound valid.
             if (delta - 1 < 0 || delta - 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             const_iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta - 1 == v->r_size)
@@ -281,7 +336,7 @@ public:
 
         const_iterator& operator--() {
             if (delta - 1 < 0 || delta - 1 > v->r_size)
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
             const_iterator temp(*this);
             // forbid vector.end() access, removing limit on others.
             if (delta - 1 == v->r_size)
@@ -297,7 +352,7 @@ public:
             if (legal)
                 return (*v)[delta];
             else
-                throw index_out_of_bound();
+                SJTU_THROW(index_out_of_bound());
         }
 
         bool operator==(const iterator& rhs) const {
@@ -325,7 +380,7 @@ public:
     //Damn C++! Why not just open a C data-structure course?
 
     //default initiator.
-    vector() : r_capacity(__INIT_CAPACITY__), container((T*)operator new[](sizeof(T) * r_capacity)), r_size(0) {
+    vector() : r_capacity(__INIT_CAPACITY__), container(__allocate(r_capacity)), r_size(0) {
         //this is malloc's error. Malloc causes unpredicted memory leak.
         //reuse operator new[] instead.
         //Cf. https://zh.cppreference.com/w/cpp/memory/new/operator_new
@@ -349,12 +404,12 @@ public:
             size <<= 1;
         r_capacity = size;
         r_size     = 0;
-        container  = (T*)operator new[](sizeof(T) * r_capacity);
+        container  = __allocate(r_capacity);
         return;
     }
 
     //copy initiator.
-    vector(const vector& other) : r_capacity(other.capacity()), container((T*)operator new[](sizeof(T) * r_capacity)), r_size(other.size()) {
+    vector(const vector& other) : r_capacity(other.capacity()), container(__allocate(r_capacity)), r_size(other.size()) {
         for (size_t i = 0; i < r_size; i++)
             new(container+i) T(other.container[i]);
         return;
@@ -364,7 +419,7 @@ public:
     ~vector() {
         for (size_t i = 0; i < r_size; i++)
             container[i].~T();
-        operator delete[](container, r_capacity * sizeof(T));
+        __deallocate(container, r_capacity);
     }
 
     //Assignment. using equal to avoid directly copying from
@@ -385,10 +440,10 @@ public:
 
             for (size_t i = 0; i < r_size; i++)
                 container[i].~T();
-            operator delete[](container, r_capacity * sizeof(T));
+            __deallocate(container, r_capacity);
             r_capacity = other.capacity();
             r_size     = other.size();
-            container  = (T*)operator new[](sizeof(T) * r_capacity);
+            container  = __allocate(r_capacity);
             for (size_t i = 0; i < r_size; i++)
                 new(container+i) T(other.container[i]);
         }
@@ -398,28 +453,37 @@ public:
     // vector.at[index] to access as vector[index]? maybe.
     T& at(const size_t& pos) {
         if (pos < 0 || pos >= r_size) {
-            throw index_out_of_bound();
+            SJTU_THROW(index_out_of_bound());
         }
         return container[pos];
     }
     const T& at(const size_t& pos) const {
         if (pos < 0 || pos >= r_size) {
-            throw index_out_of_bound();
+            SJTU_THROW(index_out_of_bound());
         }
         return container[pos];
     }
     T& operator[](const size_t& pos) { return at(pos); }
     const T& operator[](const size_t& pos) const { return at(pos); }
+    //no bounds check: pos must be below size().
+    T& unchecked(const size_t& pos) { return container[pos]; }
+    const T& unchecked(const size_t& pos) const { return container[pos]; }
+    //nullptr instead of an exception when pos is out of range.
+    T* try_get(const size_t& pos) { return pos < r_size ? container + pos : nullptr; }
+    const T* try_get(const size_t& pos) const { return pos < r_size ? container + pos : nullptr; }
+    //the size() elements in a row; invalidated by anything that reallocates.
+    T* data() { return container; }
+    const T* data() const { return container; }
 
     //front and back elements access
     const T& front() const {
         if (r_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         return *container;
     }
     const T& back() const {
         if (r_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         return *(container + r_size - 1);
     }
 
@@ -445,7 +509,9 @@ public:
             enlarge();
         }
         if (pos.legal) {
-            for (size_t i = 0; i < r_size - pos.delta; i++)
+            //the last one moves into raw memory, so it has to be constructed there.
+            new (container + r_size) T(container[r_size - 1]);
+            for (size_t i = 1; i < r_size - pos.delta; i++)
                 *(container + r_size - i) = *(container + r_size - i - 1);
             *pos = value;
             r_size++;
@@ -465,10 +531,10 @@ public:
     iterator erase(iterator pos) {
         if (r_size == 0)
             // forbid empty vector access.
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         if (!pos.legal)
             // forbid vector.end() deletion.
-            throw index_out_of_bound();
+            SJTU_THROW(index_out_of_bound());
         for (size_t i = 0; i < r_size - pos.delta - 1; i++)
             *(container + pos.delta + i) = *(container + pos.delta + i + 1);
         container[--r_size].~T();
@@ -492,16 +558,17 @@ public:
     }
     void enlarge() {
         //enlarge the space.
-        T* temp = (T*)operator new[](sizeof(T) * r_capacity << 1);
+        T* temp = __allocate(r_capacity << 1);
         for (size_t i = 0; i < r_size; i++) {
             new(temp+i) T(container[i]);
             //After malloc should destroy separately.
             //Cf. https://www.cnblogs.com/jobshunter/p/10976308.html
             container[i].~T();
         }
-        operator delete[](container, r_capacity * sizeof(T));
+        __deallocate(container, r_capacity);
         container = temp;
         r_capacity <<= 1;
+        __note_resize(true, r_capacity);
     }
     void shrink() {
         //this function is isolated.
@@ -512,21 +579,22 @@ public:
         while (r_size * 2 < temp && temp >= 8)
             temp >>= 1;
         temp <<= 1;
-        T* temp_container = (T*)operator new[](sizeof(T) * temp);
+        T* temp_container = __allocate(temp);
         for (size_t i = 0; i < r_size; i++) {
             new(temp_container+i) T(container[i]);
             container[i].~T();
         }
-        operator delete[](container, r_capacity * sizeof(T));
+        __deallocate(container, r_capacity);
         container  = temp_container;
         r_capacity = temp;
+        __note_resize(false, r_capacity);
         return;
     }
 
     //remove the last element.
     void pop_back() {
         if (r_size == 0)
-            throw container_is_empty();
+            SJTU_THROW(container_is_empty());
         else
             container[--r_size].~T();
     }